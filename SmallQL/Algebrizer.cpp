@@ -132,44 +132,48 @@ static inline ColumnsVector algebrizeSelectAggrFuncs(ColumnsVector& algebrized)
 
 static inline QTablePtr algebrizeSelectGroupBy(const SelectNode& n, QTablePtr source,
         ColumnsVector& aggrFuncs, const IntermediateType& sourceType,
-        const vector<bool>& groupPlan, int columnCount) {
+        const vector<bool>& groupPlan) {
 
-    if (n.groupBy.size() > 0 || aggrFuncs.size() > 0) {
+    if (n.groupBy.size() > 0) {
+        auto aggregate = make_unique<HashAggregateQNode>();
+        aggregate->type = sourceType;
+        aggregate->groupPlan = groupPlan;
+        for (auto& p : aggrFuncs) {
+            IntermediateTypeEntry scalar = p.first->type;
+            scalar.columnName = p.second;
+            aggregate->type.addEntry(scalar);
+            aggregate->funcs.push_back(move(p.first));
+        }
+        aggregate->source = move(source);
+        source = move(aggregate);
+    }
+    else if (aggrFuncs.size() > 0) {
         auto sorter = make_unique<SorterQNode>();
-        auto groupifier = make_unique<GroupifierQNode>();
+        auto funcProjection = make_unique<AggrFuncProjectionQNode>();
         auto degroupifier = make_unique<DegroupifierQNode>();
         sorter->type = source->type;
-        groupifier->type = source->type;
+        funcProjection->type = source->type;
         degroupifier->type = sourceType;
         for (int id = 0; id < groupPlan.size(); id++) {
             if (groupPlan[id])
                 sorter->cmpPlan.push_back(make_pair(id, false));
         }
-        groupifier->groupPlan = groupPlan;
+        funcProjection->groupPlan = groupPlan;
         if (sorter->cmpPlan.size() != 0) {
             sorter->source = move(source);
             source = move(sorter);
         }
-        groupifier->source = move(source);
-        QTablePtr groupedSource = move(groupifier);
-
-        if (aggrFuncs.size() > 0) {
-            auto funcProjection = make_unique<AggrFuncProjectionQNode>();
-            funcProjection->type = groupedSource->type;
-            int groupFuncId = columnCount;
-            for (auto& p : aggrFuncs) {
-                IntermediateTypeEntry scalar = p.first->type;
-                scalar.columnName = p.second;
-                funcProjection->type.addEntry(scalar);
-                funcProjection->funcs.push_back(move(p.first));
-                degroupifier->type.addEntry(scalar);
-                groupFuncId++;
-            }
-            funcProjection->source = move(groupedSource);
-            groupedSource = move(funcProjection);
+
+        for (auto& p : aggrFuncs) {
+            IntermediateTypeEntry scalar = p.first->type;
+            scalar.columnName = p.second;
+            funcProjection->type.addEntry(scalar);
+            funcProjection->funcs.push_back(move(p.first));
+            degroupifier->type.addEntry(scalar);
         }
+        funcProjection->source = move(source);
 
-        degroupifier->source = move(groupedSource);
+        degroupifier->source = move(funcProjection);
         source = move(degroupifier);
     }
     return source;
@@ -238,7 +242,7 @@ QTablePtr SelectNode::algebrize(const SystemInfoManager& sysMan) {
     auto projection = algebrizeSelectProjection(algebrized, source.get(), funcIndex, groupFuncIndex);
     auto aggrFuncs = algebrizeSelectAggrFuncs(algebrized);
     
-    source = algebrizeSelectGroupBy(*this, move(source), aggrFuncs, sourceType, groupPlan, columnCount);
+    source = algebrizeSelectGroupBy(*this, move(source), aggrFuncs, sourceType, groupPlan);
     
     auto funcProjection = algebrizeSelectFuncProj(source.get(), algebrized);
 
@@ -3,6 +3,9 @@
 #include <string>
 #include <assert.h>
 #include <memory>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 using namespace std;
 
@@ -44,6 +47,25 @@ static inline bool is(const shared_ptr<From>& x) {
     return dynamic_cast<To*>(x.get()) != nullptr;
 }
 
+// Index of the lowest set bit, x must not be zero
+static inline uint32_t countTrailingZeros(uint64_t x) {
+#ifdef _MSC_VER
+    unsigned long i;
+    _BitScanForward64(&i, x);
+    return i;
+#else
+    return __builtin_ctzll(x);
+#endif
+}
+
+static inline uint32_t popCount(uint64_t x) {
+#ifdef _MSC_VER
+    return (uint32_t)__popcnt64(x);
+#else
+    return __builtin_popcountll(x);
+#endif
+}
+
 template<typename T>
 static inline int cmp(T x, T y) {
     return x > y ? 1 : x < y ? -1 : 0;
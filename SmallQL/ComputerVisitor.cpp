@@ -193,80 +193,102 @@ void ComputerVisitor::visitFuncQNode(FuncQNode& n) {
     }
 }
 
-void GroupComputerVisitor::visitAggrFuncQNode(AggrFuncQNode& n) {
-    if (n.name == "SUM") {
-        bool isDouble = is<DoubleType>(n.type.type);
-        Value v = isDouble ? Value(0.0) : Value(0);
-        for (const auto& groupRow : *group) {
-            record = &groupRow;
-            n.child->accept(this);
-            if (result.type == ValueType::Null) continue;
-            if (isDouble)
-                v.doubleVal += result.doubleVal;
-            else
-                v.intVal += result.intVal;
-        }
-        result = v;
+class SumAccumulator : public Accumulator {
+private:
+    Value sum;
+public:
+    SumAccumulator(bool isDouble) : sum(isDouble ? Value(0.0) : Value(0)) {}
+    virtual void add(const Value& v) {
+        if (v.type == ValueType::Null) return;
+        if (sum.type == ValueType::Double)
+            sum.doubleVal += v.type == ValueType::Double ? v.doubleVal : v.intVal;
+        else
+            sum.intVal += v.intVal;
     }
-    else if (n.name == "AVG") {
-        bool isDouble = is<DoubleType>(n.type.type);
-        Value v = isDouble ? Value(0.0) : Value(0);
-        int count = 0;
-        for (const auto& groupRow : *group) {
-            record = &groupRow;
-            n.child->accept(this);
-            if (result.type == ValueType::Null) continue;
-            if (isDouble)
-                v.doubleVal += result.doubleVal;
-            else
-                v.intVal += result.intVal;
-            count++;
-        }
+    virtual Value getResult() const {
+        return sum;
+    }
+};
 
-        if (isDouble)
+class AvgAccumulator : public Accumulator {
+private:
+    SumAccumulator sum;
+    int64_t count;
+public:
+    AvgAccumulator(bool isDouble) : sum(isDouble), count(0) {}
+    virtual void add(const Value& v) {
+        if (v.type == ValueType::Null) return;
+        sum.add(v);
+        count++;
+    }
+    virtual Value getResult() const {
+        if (count == 0) return Value(ValueType::Null);
+        Value v = sum.getResult();
+        if (v.type == ValueType::Double)
             v.doubleVal /= count;
         else
             v.intVal /= count;
-        result = v;
+        return v;
     }
-    else if (n.name == "MIN") {
-        Value v = Value(ValueType::MaxVal);
-        for (const auto& groupRow : *group) {
-            record = &groupRow;
-            n.child->accept(this);
-            if (result.type == ValueType::Null) continue;
-            if (n.child->type.compare(result, v) < 0)
-                v = result;
+};
+
+class ExtremeAccumulator : public Accumulator {
+private:
+    const IntermediateTypeEntry& type;
+    bool isMax;
+    Value best;
+public:
+    ExtremeAccumulator(const IntermediateTypeEntry& type, bool isMax) : type(type), isMax(isMax) {}
+    virtual void add(const Value& v) {
+        if (v.type == ValueType::Null) return;
+        if (best.type == ValueType::Null) {
+            best = v;
+            return;
         }
-        result = v;
-        if (result.type == ValueType::MaxVal)
-            result.type = ValueType::Null;
+        int r = type.compare(v, best);
+        if (isMax ? r > 0 : r < 0)
+            best = v;
     }
-    else if (n.name == "MAX") {
-        Value v = Value(ValueType::MinVal);
-        for (const auto& groupRow : *group) {
-            record = &groupRow;
-            n.child->accept(this);
-            if (result.type == ValueType::Null) continue;
-            if (n.child->type.compare(result, v) > 0)
-                v = result;
-        }
-        result = v;
-        if (result.type == ValueType::MinVal)
-            result.type = ValueType::Null;
+    virtual Value getResult() const {
+        return best;
     }
-    else if (n.name == "COUNT" && is<AsteriskQNode>(n.child)) {
-        result = Value(group->size());
+};
+
+class CountAccumulator : public Accumulator {
+private:
+    bool countNulls;
+    int64_t count;
+public:
+    CountAccumulator(bool countNulls) : countNulls(countNulls), count(0) {}
+    virtual void add(const Value& v) {
+        if (countNulls || v.type != ValueType::Null)
+            count++;
+    }
+    virtual Value getResult() const {
+        return Value(count);
     }
-    else if (n.name == "COUNT") {
-        int count = 0;
-        for (const auto& groupRow : *group) {
-            record = &groupRow;
-            n.child->accept(this);
-            if (result.type != ValueType::Null) count++;
+};
+
+unique_ptr<Accumulator> makeAccumulator(const AggrFuncQNode& n) {
+    bool isDouble = is<DoubleType>(n.type.type);
+    if (n.name == "SUM")
+        return make_unique<SumAccumulator>(isDouble);
+    if (n.name == "AVG")
+        return make_unique<AvgAccumulator>(isDouble);
+    if (n.name == "MIN" || n.name == "MAX")
+        return make_unique<ExtremeAccumulator>(n.child->type, n.name == "MAX");
+    assert(n.name == "COUNT");
+    return make_unique<CountAccumulator>(is<AsteriskQNode>(n.child));
+}
+
+void AccumulatorComputerVisitor::visitAggrFuncQNode(AggrFuncQNode& n) {
+    for (int i = 0; i < aggrs.size(); i++) {
+        if (aggrs[i] == &n) {
+            result = (*accumulators)[i]->getResult();
+            return;
         }
-        result = Value(count);
     }
+    assert(false);
 }
 
 
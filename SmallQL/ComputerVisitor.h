@@ -20,21 +20,41 @@ public:
     virtual void visitAggrFuncQNode(AggrFuncQNode& n) {}
 };
 
-class GroupComputerVisitor : public ComputerVisitor {
+// Running state of one aggregate function, fed the argument value of one row at a time
+class Accumulator {
+public:
+    virtual ~Accumulator() {}
+    virtual void add(const Value& v) = 0;
+    virtual Value getResult() const = 0;
+};
+unique_ptr<Accumulator> makeAccumulator(const AggrFuncQNode& n);
+
+// Takes aggregate results from the accumulators of one group, aggrs[i] is fed to accumulators[i]
+class AccumulatorComputerVisitor : public ComputerVisitor {
 private:
-    const vector<ValueArray>* group;
+    const vector<AggrFuncQNode*>& aggrs;
+    const vector<unique_ptr<Accumulator>>* accumulators;
 public:
-    GroupComputerVisitor(const IntermediateType& type, const vector<ValueArray>* group)
-        : group(group), ComputerVisitor(type, group->size() == 0? nullptr : &(*group)[0]) {}
-    inline const Value& getResult() const {
-        return result;
-    }
-    inline void updateRecord() {
-        record = group->size() == 0? nullptr : &(*group)[0];
+    AccumulatorComputerVisitor(const IntermediateType& type, const vector<AggrFuncQNode*>& aggrs)
+        : ComputerVisitor(type, nullptr), aggrs(aggrs), accumulators(nullptr) {}
+    inline void setGroup(const ValueArray* firstRow, const vector<unique_ptr<Accumulator>>* groupAccumulators) {
+        record = firstRow;
+        accumulators = groupAccumulators;
     }
     virtual void visitAggrFuncQNode(AggrFuncQNode& n);
 };
 
+// Lists the aggregate functions inside an expression
+class AggrCollectorVisitor : public QScalarNode::RecursiveVisitor {
+private:
+    vector<AggrFuncQNode*>& aggrs;
+public:
+    AggrCollectorVisitor(vector<AggrFuncQNode*>& aggrs) : aggrs(aggrs) {}
+    virtual void visitAggrFuncQNode(AggrFuncQNode& n) {
+        aggrs.push_back(&n);
+    }
+};
+
 class CondCheckerVisitor : public QConditionNode::Visitor {
 private:
     const IntermediateType& schema;
@@ -93,6 +93,13 @@ public:
             e->accept(scalarVisitor);
         }
     }
+    virtual void visitHashAggregateQNode(HashAggregateQNode& n) {
+        RecursiveVisitor::visitHashAggregateQNode(n);
+        for (auto& e : n.funcs) {
+            scalarVisitor->setQPtr(&e);
+            e->accept(scalarVisitor);
+        }
+    }
 };
 
 void optimizeConstants(QTablePtr& tree) {
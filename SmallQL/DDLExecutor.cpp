@@ -3,6 +3,7 @@
 #include "DataFile.h"
 #include "IndexFile.h"
 #include "PrettyTablePrinter.h"
+#include "BlobManager.h"
 
 static void executeCreateTable(const CreateTableNode* n, SystemInfoManager& sysMan) {
     if (sysMan.tableExists(n->name)) {
@@ -38,7 +39,16 @@ static void executeCreateIndex(const CreateIndexNode* n, TransactionManager& trM
         cout << "Index " << n->name << " for table " << n->tableName << " already exists!" << endl;
         return;
     }
-    sysMan.createIndex(tableId, n->name, n->columns, n->isUnique);
+    // Unique indexes check the whole key, included columns would take part in it
+    if (n->isUnique && !n->includeColumns.empty()) {
+        cout << "Unique index " << n->name << " cannot have included columns!" << endl;
+        return;
+    }
+    if (n->includeColumns.size() > 63) {
+        cout << "Index " << n->name << " has too many included columns!" << endl;
+        return;
+    }
+    sysMan.createIndex(tableId, n->name, n->columns, n->isUnique, n->includeColumns);
     IndexFile indexFile(trMan, sysMan, n->tableName, n->name);
     DataFile dataFile(trMan, sysMan, n->tableName);
     bool result = indexFile.fillFrom(dataFile, sysMan.getTableSchema(n->tableName));
@@ -66,6 +76,49 @@ static void executeDropIndex(const DropIndexNode* n, SystemInfoManager& sysMan)
     cout << "Index " << n->name << " successfully dropped!" << endl;
 }
 
+static void executeVacuum(const VacuumNode* n, TransactionManager& trMan, SystemInfoManager& sysMan, BlobManager& blobManager) {
+    if (!sysMan.tableExists(n->tableName)) {
+        cout << "Table " << n->tableName << " doesn't exist!" << endl;
+        return;
+    }
+    // Freed pages can't be given back on rollback
+    if (!sysMan.autoCommitMode) {
+        cout << "VACUUM can't be used inside a transaction!" << endl;
+        return;
+    }
+    uint16_t tableId = sysMan.getTableId(n->tableName);
+    const Schema& schema = sysMan.getTableSchema(tableId);
+
+    size_t moved;
+    {
+        DataFile dataFile(trMan, sysMan, tableId);
+        vector<IndexFile> indexFiles;
+        for (uint16_t indexId : sysMan.getTableInfo(tableId).indexes) {
+            const auto& indexInfo = sysMan.getIndexInfo(tableId, indexId);
+            indexFiles.emplace_back(trMan, tableId, indexId, indexInfo.schema, indexInfo.isUnique);
+        }
+
+        auto moves = dataFile.compact();
+        moved = moves.size();
+        for (const auto& m : moves) {
+            const char* record = dataFile.readRecord(m.second);
+            const char* varData = nullptr;
+            if (schema.hasVarLenData)
+                varData = blobManager.readBlob(schema.decodeBlobId(record)).second;
+            ValueArray decoded = schema.decode(record, varData);
+            for (IndexFile& index : indexFiles) {
+                auto keys = index.getKeySchema().encodeKey(index.getKeySchema().narrow(decoded));
+                index.deleteKey(keys, m.first);
+                index.addKey(keys, m.second);
+            }
+        }
+    }
+    trMan.commit();
+    DataFile::releaseTail(trMan, tableId);
+    trMan.commit();
+    cout << "Table " << n->tableName << " successfully vacuumed, " << moved << " records moved!" << endl;
+}
+
 static void executeShow(const ShowNode* n, SystemInfoManager& sysMan) {
     if (n->what == "TABLES") {
         IntermediateType type;
@@ -137,7 +190,7 @@ static void executeTransactionOp(const TransactionOpNode* n, TransactionManager&
     }
 }
 
-bool tryDDL(const unique_ptr<StatementNode>& n, TransactionManager& trMan, SystemInfoManager& sysMan) {
+bool tryDDL(const unique_ptr<StatementNode>& n, TransactionManager& trMan, SystemInfoManager& sysMan, BlobManager& blobManager) {
     if (auto crTab = convert<CreateTableNode>(n)) {
         executeCreateTable(crTab, sysMan);
         return true;
@@ -154,6 +207,10 @@ bool tryDDL(const unique_ptr<StatementNode>& n, TransactionManager& trMan, Syste
         executeDropIndex(drInd, sysMan);
         return true;
     }
+    if (auto vacuum = convert<VacuumNode>(n)) {
+        executeVacuum(vacuum, trMan, sysMan, blobManager);
+        return true;
+    }
     if (auto show = convert<ShowNode>(n)) {
         executeShow(show, sysMan);
         return true;
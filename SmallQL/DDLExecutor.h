@@ -2,5 +2,6 @@
 
 #include "SqlAst.h"
 #include "SystemInfoManager.h"
+#include "BlobManager.h"
 
-bool tryDDL(const unique_ptr<StatementNode>& n, TransactionManager& trMan, SystemInfoManager& sysMan);
\ No newline at end of file
+bool tryDDL(const unique_ptr<StatementNode>& n, TransactionManager& trMan, SystemInfoManager& sysMan, BlobManager& blobManager);
\ No newline at end of file
@@ -2,27 +2,50 @@
 
 #include <iostream>
 
-const uint64_t FRL_MASK = 0x00FFFFFFFFFFFFFFul;
-
 #define DATAFILE_ID(tableId) ((tableId & 0xFFFF) << 16 | 0xFFFF)
+#define LIVEMAP_ID(tableId) ((tableId & 0xFFFF) << 16 | 0xFFFE)
+
+// A free slot has 0x00 in its validity byte and the next free slot in the 7 bytes after it,
+// the last one has 0xFF instead
+static void writeFreeLink(char* record, RecordId next) {
+    uint64_t link = next == NULL64 ? 0xFF : next << 8;
+    memcpy(record, &link, 8);
+}
+
+static bool readFreeLink(const char* record, RecordId& next) {
+    uint8_t flag = (uint8_t)record[0];
+    if (flag == 0xFF) {
+        next = NULL64;
+        return true;
+    }
+    if (flag != 0x00) return false;
+    uint64_t link;
+    memcpy(&link, record, 8);
+    next = link >> 8;
+    return true;
+}
 
 DataFile::DataFile(TransactionManager& trMan, int tableId)
-    : Pager(trMan, DATAFILE_ID(tableId)) {
+    : Pager(trMan, DATAFILE_ID(tableId)), liveMap(trMan, LIVEMAP_ID(tableId)) {
     Page headerPage = retrieveWrite(0);
     if (memcmp(headerPage, "SmDD", 4) != 0) {
         cout << "ERROR! Table not found" << endl;
         exit(1);
     }
     initPointers(headerPage);
+    if (headerPage[0x0C] != 0x01)
+        buildLiveMap(headerPage);
 }
 
 DataFile::DataFile(TransactionManager& trMan, int tableId, uint32_t recordSize)
-    : Pager(trMan, DATAFILE_ID(tableId)) {
+    : Pager(trMan, DATAFILE_ID(tableId)), liveMap(trMan, LIVEMAP_ID(tableId)) {
     Page headerPage = retrieveWrite(0);
     if (memcmp(headerPage, "SmDD", 4) != 0) {
         initFile(tableId, recordSize, headerPage);
     }
     initPointers(headerPage);
+    if (headerPage[0x0C] != 0x01)
+        buildLiveMap(headerPage);
 }
 
 DataFile::DataFile(TransactionManager& trMan, const SystemInfoManager& sysMan, int tableId)
@@ -35,6 +58,20 @@ DataFile::DataFile(TransactionManager& trMan, const SystemInfoManager& sysMan, s
 
 void DataFile::deleteFile(TransactionManager& trMan, int tableId) {
     trMan.deleteFile(DATAFILE_ID(tableId));
+    trMan.deleteFile(LIVEMAP_ID(tableId));
+}
+
+void DataFile::releaseTail(TransactionManager& trMan, int tableId) {
+    PageId dataPages, livePages;
+    {
+        DataFile dataFile(trMan, tableId);
+        RecordId first, end;
+        RecordId total = *dataFile.totalRecordCount;
+        dataPages = total == 0 ? 1 : dataFile.pageOf(total - 1, first, end) + 1;
+        livePages = (dataPages + dataFile.liveSlotsPerPage - 1) / dataFile.liveSlotsPerPage;
+    }
+    trMan.truncateFile(DATAFILE_ID(tableId), dataPages);
+    trMan.truncateFile(LIVEMAP_ID(tableId), livePages);
 }
 
 void DataFile::initPointers(Page headerPage) {
@@ -49,6 +86,18 @@ void DataFile::initPointers(Page headerPage) {
 
     recordsPerPage = PAGE_SIZE / trueRecordSize;
     recordsPerZeroPage = (PAGE_SIZE - 0x40) / trueRecordSize;
+    liveSlotWords = 1 + (recordsPerPage + 63) / 64;
+    liveSlotsPerPage = PAGE_SIZE / (8 * liveSlotWords);
+}
+
+// Files written before the live map existed get one on first open
+void DataFile::buildLiveMap(Page headerPage) {
+    for (RecordId id = 0; id < *totalRecordCount; id++) {
+        if (readRecord(id) != NULL)
+            setLive(id, true);
+    }
+    headerPage[0x0C] = 0x01;
+    update(0);
 }
 
 void DataFile::initFile(int tableId, uint32_t recordSize, Page headerPage) {
@@ -60,6 +109,7 @@ void DataFile::initFile(int tableId, uint32_t recordSize, Page headerPage) {
     *(uint64_t*)(headerPage + 0x10) = 0;
     *(uint64_t*)(headerPage + 0x18) = 0;
     *(RecordId*)(headerPage + 0x20) = NULL64;
+    headerPage[0x0C] = 0x01;
     update(0);
 }
 
@@ -78,6 +128,62 @@ char* DataFile::readRecordInternal(RecordId id, bool isRead) const {
     return p + offset;
 }
 
+PageId DataFile::pageOf(RecordId id, RecordId& first, RecordId& end) const {
+    if (id < recordsPerZeroPage) {
+        first = 0;
+        end = recordsPerZeroPage;
+        return 0;
+    }
+
+    PageId pageId = (id - recordsPerZeroPage) / recordsPerPage + 1;
+    first = recordsPerZeroPage + (RecordId)(pageId - 1) * recordsPerPage;
+    end = first + recordsPerPage;
+    return pageId;
+}
+
+const char* DataFile::readPage(PageId pageId, PageHandle& handle) const {
+    if (pageId == 0) return page0Data;
+    handle = readHandle(pageId);
+    return handle.get();
+}
+
+const uint64_t* DataFile::readLiveSlot(PageId pageId, PageHandle& handle) const {
+    handle = liveMap.readHandle(pageId / liveSlotsPerPage);
+    return (const uint64_t*)(handle.get() + (size_t)(pageId % liveSlotsPerPage) * liveSlotWords * 8);
+}
+
+void DataFile::setLive(RecordId id, bool live) {
+    RecordId first, end;
+    PageId pageId = pageOf(id, first, end);
+    PageId livePage = pageId / liveSlotsPerPage;
+    uint64_t* slot = (uint64_t*)(liveMap.retrieveWrite(livePage) + (size_t)(pageId % liveSlotsPerPage) * liveSlotWords * 8);
+    uint64_t& word = slot[1 + (id - first) / 64];
+    uint64_t bit = 1ull << ((id - first) % 64);
+    if (((word & bit) != 0) == live) return;
+    word ^= bit;
+    if (live) slot[0]++;
+    else slot[0]--;
+    liveMap.update(livePage);
+}
+
+// Marks [from, to) live, the range must lie within one data page
+void DataFile::setLiveRange(RecordId from, RecordId to) {
+    RecordId first, end;
+    PageId pageId = pageOf(from, first, end);
+    PageId livePage = pageId / liveSlotsPerPage;
+    uint64_t* slot = (uint64_t*)(liveMap.retrieveWrite(livePage) + (size_t)(pageId % liveSlotsPerPage) * liveSlotWords * 8);
+    uint32_t i = (uint32_t)(from - first), last = (uint32_t)(to - first);
+    while (i < last) {
+        uint32_t word = i / 64;
+        uint32_t high = min(last - word * 64, 64u);
+        uint64_t mask = (high == 64 ? NULL64 : (1ull << high) - 1) & (NULL64 << (i % 64));
+        slot[0] += popCount(mask & ~slot[1 + word]);
+        slot[1 + word] |= mask;
+        i = word * 64 + high;
+    }
+    liveMap.update(livePage);
+}
+
 const char* DataFile::readRecord(RecordId id) const {
     char* record = readRecordInternal(id, true);
     if (record[0] != 0x01) return NULL;
@@ -100,19 +206,18 @@ RecordId DataFile::addRecord(const char* data) {
     if (*frlStart != NULL64) {
         newId = *frlStart;
         char* frl = readRecordInternal(newId, false);
-        if (frl[0] != 0x00 && frl[0] != 0xFF) {
+        if (!readFreeLink(frl, *frlStart)) {
             cout << "File is in incorrect format!" << endl;
             return NULL64;
         }
         PageId frlPage = lastReadPage;
 
-        memcpy(frlStart, frl, 8);
-        *frlStart &= FRL_MASK;
         memcpy(frl + 1, data, recordSize);
         frl[0] = 0x01;
         (*activeRecordCount)++;
         update(0);
         update(frlPage);
+        setLive(newId, true);
     }
     else {
         newId = *totalRecordCount;
@@ -123,19 +228,91 @@ RecordId DataFile::addRecord(const char* data) {
         record[0] = 0x01;
         memcpy(record + 1, data, recordSize);
         update(lastReadPage);
+        setLive(newId, true);
     }
     return newId;
 }
 
+vector<RecordId> DataFile::addRecords(const char* data, size_t count) {
+    vector<RecordId> ids;
+    ids.reserve(count);
+    size_t done = 0;
+    for (; done < count && *frlStart != NULL64; done++) {
+        RecordId newId = *frlStart;
+        char* frl = readRecordInternal(newId, false);
+        if (!readFreeLink(frl, *frlStart)) {
+            cout << "File is in incorrect format!" << endl;
+            break;
+        }
+        memcpy(frl + 1, data + done * recordSize, recordSize);
+        frl[0] = 0x01;
+        update(lastReadPage);
+        setLive(newId, true);
+        ids.push_back(newId);
+    }
+
+    // The rest goes past the end, filling each page in one go
+    RecordId id = *totalRecordCount;
+    RecordId newTotal = id + (count - done);
+    while (id < newTotal) {
+        RecordId first, end;
+        pageOf(id, first, end);
+        RecordId last = min(end, newTotal);
+        char* record = readRecordInternal(id, false);
+        for (RecordId i = id; i < last; i++, done++) {
+            record[0] = 0x01;
+            memcpy(record + 1, data + done * recordSize, recordSize);
+            record += trueRecordSize;
+            ids.push_back(i);
+        }
+        update(lastReadPage);
+        setLiveRange(id, last);
+        id = last;
+    }
+
+    *totalRecordCount = newTotal;
+    *activeRecordCount += ids.size();
+    update(0);
+    return ids;
+}
+
 bool DataFile::deleteRecord(RecordId id) {
     char* record = readRecordInternal(id, false);
     if (record[0] != 0x01) return false;
-    RecordId newFrl = *frlStart;
-    memcpy(record, frlStart, 8);
-    if (record[0] != 0xFF) record[0] = 0x00;
+    writeFreeLink(record, *frlStart);
     *frlStart = id;
     (*activeRecordCount)--;
     update(0);
     update(lastReadPage);
+    setLive(id, false);
     return true;
-}
\ No newline at end of file
+}
+
+vector<pair<RecordId, RecordId>> DataFile::compact() {
+    vector<pair<RecordId, RecordId>> moves;
+    RecordId low = 0, high = *totalRecordCount;
+    while (true) {
+        while (low < high && readRecord(low) != NULL) low++;
+        while (high > low && readRecord(high - 1) == NULL) high--;
+        if (low >= high) break;
+        high--;
+
+        char* from = readRecordInternal(high, false);
+        PageId fromPage = lastReadPage;
+        char* to = readRecordInternal(low, false);
+        to[0] = 0x01;
+        memcpy(to + 1, from + 1, recordSize);
+        from[0] = 0x00;
+        update(lastReadPage);
+        update(fromPage);
+        setLive(low, true);
+        setLive(high, false);
+        moves.emplace_back(high, low);
+    }
+
+    // Every slot below the new end is live now, so the free list is empty
+    *totalRecordCount = high;
+    *frlStart = NULL64;
+    update(0);
+    return moves;
+}
@@ -16,17 +16,30 @@ class DataFile : public Pager {
     uint32_t recordsPerPage;
     uint32_t recordsPerZeroPage;
 
+    // Side file with a live count and a live record bitmap for every data page
+    Pager liveMap;
+    uint32_t liveSlotWords;
+    uint32_t liveSlotsPerPage;
+
     mutable PageId lastReadPage;
 
     void initFile(int tableId, uint32_t recordSize, Page headerPage);
     void initPointers(Page headerPage);
+    void buildLiveMap(Page headerPage);
     char* readRecordInternal(RecordId id, bool isRead) const;
+    PageId pageOf(RecordId id, RecordId& first, RecordId& end) const;
+    const char* readPage(PageId pageId, PageHandle& handle) const;
+    const uint64_t* readLiveSlot(PageId pageId, PageHandle& handle) const;
+    void setLive(RecordId id, bool live);
+    void setLiveRange(RecordId from, RecordId to);
 public:
     DataFile(TransactionManager& trMan, int tableId);
     DataFile(TransactionManager& trMan, int tableId, uint32_t recordSize);
     DataFile(TransactionManager& trMan, const SystemInfoManager& sysMan, int tableId);
     DataFile(TransactionManager& trMan, const SystemInfoManager& sysMan, string tableName);
     static void deleteFile(TransactionManager& trMan, int tableId);
+    // Frees the pages past the last record, to be called outside of a transaction
+    static void releaseTail(TransactionManager& trMan, int tableId);
 
     const char* readRecord(RecordId id) const;
     inline vector<char> readRecordVector(RecordId id) const {
@@ -41,7 +54,11 @@ public:
     inline RecordId addRecord(const vector<char>& data) {
         return addRecord(data.data());
     }
+    // Adds count records packed back to back, reusing free slots first and appending the rest page by page
+    vector<RecordId> addRecords(const char* data, size_t count);
     bool deleteRecord(RecordId id);
+    // Moves records from the end of the file into free slots, returns (old id, new id) pairs
+    vector<pair<RecordId, RecordId>> compact();
     inline uint32_t getRecordSize() const {
         return recordSize;
     }
@@ -58,24 +75,60 @@ public:
         RecordId recordId;
         value_type value;
         const DataFile* dataFile;
-        void updateValue() {
-            if (recordId == *dataFile->totalRecordCount) return;
-            value = const_cast<value_type>(dataFile->readRecord(recordId));
-            assert(value != NULL);
+        // Current page and its live slot, pinned by the iterator while the scan stays on them
+        PageHandle dataPage;
+        PageHandle livePage;
+        const char* pageData;
+        const uint64_t* liveSlot;
+        PageId pageId;
+        RecordId pageFirst, pageEnd;
+
+        // Moves to the first live record at or after recordId, skipping empty pages unread
+        void seek() {
+            RecordId total = *dataFile->totalRecordCount;
+            while (recordId < total) {
+                if (recordId < pageFirst || recordId >= pageEnd) {
+                    pageId = dataFile->pageOf(recordId, pageFirst, pageEnd);
+                    liveSlot = dataFile->readLiveSlot(pageId, livePage);
+                    pageData = NULL;
+                }
+                if (liveSlot[0] != 0) {
+                    uint32_t end = (uint32_t)(min(pageEnd, total) - pageFirst);
+                    for (uint32_t i = (uint32_t)(recordId - pageFirst); i < end; i = (i | 63) + 1) {
+                        uint64_t word = liveSlot[1 + i / 64] & (NULL64 << (i % 64));
+                        if (word == 0) continue;
+                        i = (i & ~63u) + countTrailingZeros(word);
+                        if (i >= end) break;
+                        if (!pageData)
+                            pageData = dataFile->readPage(pageId, dataPage);
+                        recordId = pageFirst + i;
+                        value = const_cast<value_type>(pageData + (size_t)i * dataFile->trueRecordSize + 1);
+                        return;
+                    }
+                }
+                recordId = min(pageEnd, total);
+            }
         }
     public:
         CustomIterator(RecordId recordId, value_type value, const DataFile* dataFile)
             : recordId(recordId)
             , value(value)
-            , dataFile(dataFile){}
+            , dataFile(dataFile)
+            , pageData(NULL)
+            , liveSlot(NULL)
+            , pageId(NULL32)
+            , pageFirst(0)
+            , pageEnd(0) {}
         CustomIterator(RecordId recordId, const DataFile* dataFile)
             : recordId(recordId)
             , value(NULL)
-            , dataFile(dataFile){
-            while (this->recordId < *dataFile->totalRecordCount && dataFile->readRecord(this->recordId) == NULL)
-                this->recordId++;
-            if (this->recordId < *dataFile->totalRecordCount)
-                updateValue();
+            , dataFile(dataFile)
+            , pageData(NULL)
+            , liveSlot(NULL)
+            , pageId(NULL32)
+            , pageFirst(0)
+            , pageEnd(0) {
+            seek();
         }
 
         reference operator*() const { return value; }
@@ -83,11 +136,8 @@ public:
 
         // Prefix increment
         CustomIterator& operator++() {
-            do {
-                recordId++; 
-            } while (recordId < *dataFile->totalRecordCount && dataFile->readRecord(recordId) == NULL);
-            if (recordId < *dataFile->totalRecordCount)
-                updateValue();
+            recordId++;
+            seek();
             return *this; 
         }  
 
@@ -112,12 +162,14 @@ public:
     using iterator = CustomIterator<char*>;
 
     iterator begin() {
+        advise(AccessPattern::Sequential);
         return iterator(0, this);
     }
     iterator end() {
         return iterator(*totalRecordCount, NULL, this);
     }
     const_iterator begin() const {
+        advise(AccessPattern::Sequential);
         return const_iterator(0, this);
     }
     const_iterator end() const {
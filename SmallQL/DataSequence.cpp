@@ -49,19 +49,20 @@ TableIndexScanDS::TableIndexScanDS(const Schema& schema, DataFile& data, IndexFi
     , index(index)
     , blobManager(blobManager)
     , iter(index.end())
-    , from(from)
-    , to(to)
-    , incFrom(incFrom)
-    , incTo(incTo)
+    , from(index.makeBound(from, incFrom, true))
+    , to(index.makeBound(to, incTo, false))
     , schema(schema)
     , recordData(make_unique<ValueArray>())
     , DataSequence(IntermediateType(schema)) {
     record.record = recordData.get();
 }
-void TableIndexScanDS::reset() {
-    iter = index.getIterator(from);
+// Bounds are checked on the index keys, the record is only read once it is in range
+void TableIndexScanDS::update() {
     if (iter == index.end()) return;
-
+    if (!IndexFile::isWithinUpper(iter.getKey(), to)) {
+        iter = index.end();
+        return;
+    }
     record.recordId = *iter;
     const char* r = data.readRecord(record.recordId);
     const char* varData = nullptr;
@@ -70,46 +71,62 @@ void TableIndexScanDS::reset() {
         auto p = blobManager.readBlob(blobId);
         varData = p.second;
     }
-
     *recordData = schema.decode(r, varData);
-    if (!incFrom) {
-        while (index.getKeySchema().compare(from, *recordData) == 0) {
-            iter++;
-            record.recordId = *iter;
-
-            r = data.readRecord(record.recordId);
-            varData = nullptr;
-            if (schema.hasVarLenData) {
-                BlobId blobId = schema.decodeBlobId(r);
-                auto p = blobManager.readBlob(blobId);
-                varData = p.second;
-            }
-            *recordData = schema.decode(r, varData);
-            if (iter == index.end()) return;
-        }
-    }
+}
+void TableIndexScanDS::setRange(const ValueArray& from, const ValueArray& to, bool incFrom, bool incTo) {
+    this->from = index.makeBound(from, incFrom, true);
+    this->to = index.makeBound(to, incTo, false);
+}
+void TableIndexScanDS::reset() {
+    iter = index.lowerBound(from);
+    update();
 }
 void TableIndexScanDS::advance() {
     if (iter == index.end()) return;
     iter++;
-    record.recordId = *iter;
-    const char* r = data.readRecord(record.recordId);
-    const char* varData = nullptr;
-    if (schema.hasVarLenData) {
-        BlobId blobId = schema.decodeBlobId(r);
-        auto p = blobManager.readBlob(blobId);
-        varData = p.second;
-    }
-    *recordData = schema.decode(r, varData);
-    int cmpVal = index.getKeySchema().compare(to, *recordData);
-    if (cmpVal < 0 || !incTo && cmpVal == 0)
-        iter = index.end();
+    update();
 }
 bool TableIndexScanDS::hasEnded() const {
     return iter == index.end();
 }
 
 
+IndexOnlyScanDS::IndexOnlyScanDS(const Schema& schema, const Schema& keySchema, IndexFile& index,
+        ValueArray from, ValueArray to, bool incFrom, bool incTo)
+    : index(index)
+    , iter(index.end())
+    , keySchema(keySchema)
+    , from(index.makeBound(from, incFrom, true))
+    , to(index.makeBound(to, incTo, false))
+    , recordData(make_unique<ValueArray>(schema.columns.size()))
+    , DataSequence(IntermediateType(schema)) {
+    record.record = recordData.get();
+}
+void IndexOnlyScanDS::update() {
+    if (iter == index.end()) return;
+    if (!IndexFile::isWithinUpper(iter.getKey(), to)) {
+        iter = index.end();
+        return;
+    }
+    record.recordId = *iter;
+    ValueArray keys = keySchema.decodeKey(iter.getKey());
+    for (int i = 0; i < keys.size(); i++)
+        (*recordData)[keySchema.columns[i].id] = keys[i];
+}
+void IndexOnlyScanDS::reset() {
+    iter = index.lowerBound(from);
+    update();
+}
+void IndexOnlyScanDS::advance() {
+    if (iter == index.end()) return;
+    iter++;
+    update();
+}
+bool IndexOnlyScanDS::hasEnded() const {
+    return iter == index.end();
+}
+
+
 ProjectorDS::ProjectorDS(const IntermediateType& type,
     DataSequence* source,
     vector<uint16_t> columns)
@@ -431,6 +448,370 @@ void CondJoinDS::rightNullStep() {
 }
 
 
+HashJoinDS::HashJoinDS(const IntermediateType& type, DataSequence* left, DataSequence* right, JoinType joinType,
+    vector<pair<uint16_t, uint16_t>> keys, unique_ptr<QConditionNode> cond)
+    : left(left)
+    , right(right)
+    , joinType(joinType)
+    , keys(keys)
+    , cond(move(cond))
+    , recordData(make_unique<ValueArray>(type.entries.size()))
+    , offset(left->getType().entries.size())
+    , isLeftJoin(joinType == JoinType::Left || joinType == JoinType::Full)
+    , isRightJoin(joinType == JoinType::Right || joinType == JoinType::Full)
+    , bucketMask(0)
+    , hasBeenBuilt(false)
+    , probeRow(-1)
+    , leftMatched(false)
+    , rightNullWalk(false)
+    , rightNullIndex(0)
+    , ended(true)
+    , DataSequence(type) {
+    record.record = recordData.get();
+    visitor = make_unique<CondCheckerVisitor>(type, record.record);
+}
+
+size_t HashJoinDS::hashKeys(const ValueArray& row, bool isLeft) const {
+    size_t h = 0;
+    for (const auto& p : keys)
+        h = h * 0x9E3779B97F4A7C15ull + hashValue(row[isLeft ? p.first : p.second]);
+    return h ^ (h >> 29);
+}
+
+void HashJoinDS::build() {
+    right->reset();
+    while (!right->hasEnded()) {
+        rightRows.push_back(*right->get().record);
+        right->advance();
+    }
+    size_t bucketCount = 16;
+    while (bucketCount < rightRows.size() * 2)
+        bucketCount *= 2;
+    bucketMask = bucketCount - 1;
+    buckets.assign(bucketCount, -1);
+    bucketTails.assign(bucketCount, -1);
+    nextRow.assign(rightRows.size(), -1);
+    for (int i = 0; i < rightRows.size(); i++) {
+        size_t bucket = hashKeys(rightRows[i], false) & bucketMask;
+        if (bucketTails[bucket] == -1)
+            buckets[bucket] = i;
+        else
+            nextRow[bucketTails[bucket]] = i;
+        bucketTails[bucket] = i;
+    }
+    hasBeenBuilt = true;
+}
+
+void HashJoinDS::startLeft() {
+    if (left->hasEnded()) return;
+    const ValueArray& leftData = *left->get().record;
+    for (int i = 0; i < offset; i++)
+        (*recordData)[i] = leftData[i];
+    probeRow = buckets[hashKeys(leftData, true) & bucketMask];
+    leftMatched = false;
+}
+
+void HashJoinDS::findNext() {
+    while (!rightNullWalk) {
+        if (left->hasEnded()) {
+            if (!isRightJoin) {
+                ended = true;
+                return;
+            }
+            rightNullWalk = true;
+            rightNullIndex = -1;
+            for (int i = 0; i < offset; i++)
+                (*recordData)[i] = Value(ValueType::Null);
+            break;
+        }
+        while (probeRow != -1) {
+            int candidate = probeRow;
+            probeRow = nextRow[probeRow];
+            const ValueArray& rightData = rightRows[candidate];
+            bool isEqual = true;
+            for (const auto& p : keys) {
+                if (compareValue((*recordData)[p.first], rightData[p.second]) != 0) {
+                    isEqual = false;
+                    break;
+                }
+            }
+            if (!isEqual) continue;
+            for (int i = 0; i < rightData.size(); i++)
+                (*recordData)[offset + i] = rightData[i];
+            if (cond) {
+                cond->accept(visitor.get());
+                if (!visitor->getResult()) continue;
+            }
+            leftMatched = true;
+            if (isRightJoin)
+                rightMatched[candidate] = true;
+            return;
+        }
+        if (isLeftJoin && !leftMatched) {
+            for (int i = offset; i < recordData->size(); i++)
+                (*recordData)[i] = Value(ValueType::Null);
+            leftMatched = true;
+            return;
+        }
+        left->advance();
+        startLeft();
+    }
+
+    rightNullIndex++;
+    while (rightNullIndex < rightRows.size() && rightMatched[rightNullIndex])
+        rightNullIndex++;
+    if (rightNullIndex >= rightRows.size()) {
+        ended = true;
+        return;
+    }
+    const ValueArray& rightData = rightRows[rightNullIndex];
+    for (int i = 0; i < rightData.size(); i++)
+        (*recordData)[offset + i] = rightData[i];
+}
+
+void HashJoinDS::reset() {
+    if (!hasBeenBuilt)
+        build();
+    rightMatched.assign(rightRows.size(), false);
+    rightNullWalk = false;
+    ended = false;
+    left->reset();
+    startLeft();
+    findNext();
+}
+void HashJoinDS::advance() {
+    if (ended) return;
+    findNext();
+}
+bool HashJoinDS::hasEnded() const {
+    return ended;
+}
+
+
+IndexJoinDS::IndexJoinDS(const IntermediateType& type, DataSequence* left, TableIndexScanDS* right, JoinType joinType,
+    vector<pair<uint16_t, uint16_t>> keys, vector<uint16_t> lookupColumns, int keySize,
+    unique_ptr<QConditionNode> cond)
+    : left(left)
+    , right(right)
+    , joinType(joinType)
+    , keys(keys)
+    , lookupColumns(lookupColumns)
+    , from(keySize, Value(ValueType::MinVal))
+    , to(keySize, Value(ValueType::MaxVal))
+    , cond(move(cond))
+    , recordData(make_unique<ValueArray>(type.entries.size()))
+    , offset(left->getType().entries.size())
+    , leftMatched(false)
+    , ended(true)
+    , DataSequence(type) {
+    record.record = recordData.get();
+    visitor = make_unique<CondCheckerVisitor>(type, record.record);
+}
+
+// Both bounds hold the lookup values followed by open columns, so the scan covers exactly the equal keys
+void IndexJoinDS::startLeft() {
+    if (left->hasEnded()) return;
+    const ValueArray& leftData = *left->get().record;
+    for (int i = 0; i < offset; i++)
+        (*recordData)[i] = leftData[i];
+    for (int i = 0; i < lookupColumns.size(); i++) {
+        from[i] = leftData[lookupColumns[i]];
+        to[i] = leftData[lookupColumns[i]];
+    }
+    right->setRange(from, to, true, true);
+    right->reset();
+    leftMatched = false;
+}
+
+void IndexJoinDS::findNext() {
+    while (!left->hasEnded()) {
+        while (!right->hasEnded()) {
+            const ValueArray& rightData = *right->get().record;
+            for (int i = 0; i < rightData.size(); i++)
+                (*recordData)[offset + i] = rightData[i];
+            right->advance();
+            bool isEqual = true;
+            for (const auto& p : keys) {
+                if (compareValue((*recordData)[p.first], (*recordData)[offset + p.second]) != 0) {
+                    isEqual = false;
+                    break;
+                }
+            }
+            if (!isEqual) continue;
+            if (cond) {
+                cond->accept(visitor.get());
+                if (!visitor->getResult()) continue;
+            }
+            leftMatched = true;
+            return;
+        }
+        if (joinType == JoinType::Left && !leftMatched) {
+            for (int i = offset; i < recordData->size(); i++)
+                (*recordData)[i] = Value(ValueType::Null);
+            leftMatched = true;
+            return;
+        }
+        left->advance();
+        startLeft();
+    }
+    ended = true;
+}
+
+void IndexJoinDS::reset() {
+    ended = false;
+    left->reset();
+    startLeft();
+    findNext();
+}
+void IndexJoinDS::advance() {
+    if (ended) return;
+    findNext();
+}
+bool IndexJoinDS::hasEnded() const {
+    return ended;
+}
+
+
+MergeJoinDS::MergeJoinDS(const IntermediateType& type, DataSequence* left, DataSequence* right, JoinType joinType,
+    vector<pair<uint16_t, uint16_t>> keys, unique_ptr<QConditionNode> cond)
+    : left(left)
+    , right(right)
+    , joinType(joinType)
+    , keys(keys)
+    , cond(move(cond))
+    , recordData(make_unique<ValueArray>(type.entries.size()))
+    , offset(left->getType().entries.size())
+    , isLeftJoin(joinType == JoinType::Left || joinType == JoinType::Full)
+    , isRightJoin(joinType == JoinType::Right || joinType == JoinType::Full)
+    , runIndex(0)
+    , leftMatched(false)
+    , ended(true)
+    , DataSequence(type) {
+    record.record = recordData.get();
+    visitor = make_unique<CondCheckerVisitor>(type, record.record);
+}
+
+void MergeJoinDS::closeRun() {
+    if (isRightJoin) {
+        for (int i = 0; i < run.size(); i++)
+            if (!runMatched[i])
+                unmatchedRight.push_back(move(run[i]));
+    }
+    run.clear();
+    runMatched.clear();
+}
+
+// Moves the right side up to the key of the new left row and buffers its run of equal keys
+void MergeJoinDS::startLeft() {
+    if (left->hasEnded()) {
+        closeRun();
+        while (isRightJoin && !right->hasEnded()) {
+            unmatchedRight.push_back(*right->get().record);
+            right->advance();
+        }
+        return;
+    }
+    leftMatched = false;
+    runIndex = 0;
+    const Value& leftKey = (*left->get().record)[keys[0].first];
+    if (!run.empty()) {
+        int r = compareValue(leftKey, runKey);
+        if (r == 0) return;
+        if (r < 0) {
+            runIndex = run.size();
+            return;
+        }
+        closeRun();
+    }
+    while (!right->hasEnded()) {
+        const ValueArray& rightData = *right->get().record;
+        int r = compareValue(rightData[keys[0].second], leftKey);
+        if (r > 0) break;
+        if (r < 0) {
+            if (isRightJoin)
+                unmatchedRight.push_back(rightData);
+            right->advance();
+            continue;
+        }
+        runKey = rightData[keys[0].second];
+        do {
+            run.push_back(*right->get().record);
+            right->advance();
+        } while (!right->hasEnded() && compareValue((*right->get().record)[keys[0].second], runKey) == 0);
+        runMatched.assign(run.size(), false);
+        break;
+    }
+}
+
+void MergeJoinDS::findNext() {
+    while (true) {
+        if (!unmatchedRight.empty()) {
+            for (int i = 0; i < offset; i++)
+                (*recordData)[i] = Value(ValueType::Null);
+            const ValueArray& rightData = unmatchedRight.back();
+            for (int i = 0; i < rightData.size(); i++)
+                (*recordData)[offset + i] = rightData[i];
+            unmatchedRight.pop_back();
+            return;
+        }
+        if (left->hasEnded()) {
+            ended = true;
+            return;
+        }
+        const ValueArray& leftData = *left->get().record;
+        for (int i = 0; i < offset; i++)
+            (*recordData)[i] = leftData[i];
+        while (runIndex < run.size()) {
+            int candidate = runIndex++;
+            const ValueArray& rightData = run[candidate];
+            bool isEqual = true;
+            for (int i = 1; i < keys.size(); i++) {
+                if (compareValue(leftData[keys[i].first], rightData[keys[i].second]) != 0) {
+                    isEqual = false;
+                    break;
+                }
+            }
+            if (!isEqual) continue;
+            for (int i = 0; i < rightData.size(); i++)
+                (*recordData)[offset + i] = rightData[i];
+            if (cond) {
+                cond->accept(visitor.get());
+                if (!visitor->getResult()) continue;
+            }
+            leftMatched = true;
+            runMatched[candidate] = true;
+            return;
+        }
+        if (isLeftJoin && !leftMatched) {
+            for (int i = offset; i < recordData->size(); i++)
+                (*recordData)[i] = Value(ValueType::Null);
+            leftMatched = true;
+            return;
+        }
+        left->advance();
+        startLeft();
+    }
+}
+
+void MergeJoinDS::reset() {
+    run.clear();
+    runMatched.clear();
+    unmatchedRight.clear();
+    ended = false;
+    left->reset();
+    right->reset();
+    startLeft();
+    findNext();
+}
+void MergeJoinDS::advance() {
+    if (ended) return;
+    findNext();
+}
+bool MergeJoinDS::hasEnded() const {
+    return ended;
+}
+
+
 SorterDS::SorterDS(const IntermediateType& type,
     DataSequence* source,
     vector<pair<int, bool>> cmpPlan) 
@@ -533,14 +914,14 @@ bool Inserter::insert(RecordPtr record) {
     ValueArray decoded = *record.record;
     for (IndexFile& index : indexFiles) {
         ValueArray keyValues = index.getKeySchema().narrow(decoded);
-        auto keys = index.getKeySchema().encode(keyValues);
-        bool result = index.addKey(keys.first, recordId);
+        auto keys = index.getKeySchema().encodeKey(keyValues);
+        bool result = index.addKey(keys, recordId);
         if (!result) {
 
             for (IndexFile& index : indexFiles) {
                 ValueArray keyValues = index.getKeySchema().narrow(decoded);
-                auto keys = index.getKeySchema().encode(keyValues);
-                index.deleteKey(keys.first, recordId);
+                auto keys = index.getKeySchema().encodeKey(keyValues);
+                index.deleteKey(keys, recordId);
             }
 
             dataFile.deleteRecord(recordId);
@@ -550,14 +931,50 @@ bool Inserter::insert(RecordPtr record) {
     return true;
 }
 
+// Rows are encoded straight into one buffer and written a batch at a time
+const size_t INSERT_BATCH_BYTES = 1 << 20;
+
+bool Inserter::insertBatch(const vector<char>& batch, const vector<ValueArray>& rows) {
+    vector<RecordId> ids = dataFile.addRecords(batch.data(), rows.size());
+    for (IndexFile& index : indexFiles) {
+        vector<pair<vector<char>, RecordId>> keys;
+        keys.reserve(rows.size());
+        for (size_t i = 0; i < rows.size(); i++) {
+            ValueArray keyValues = index.getKeySchema().narrow(rows[i]);
+            keys.emplace_back(index.getKeySchema().encodeKey(keyValues), ids[i]);
+        }
+        // A failed statement is rolled back, so a half inserted batch isn't undone here
+        if (!index.addKeys(keys))
+            return false;
+    }
+    return true;
+}
+
 pair<bool, int> Inserter::insert(DataSequence* source) {
+    size_t recordSize = dataFile.getRecordSize();
+    size_t batchRows = max((size_t)1, INSERT_BATCH_BYTES / recordSize);
+    vector<char> batch;
+    vector<ValueArray> rows;
     int count = 0;
     source->reset();
     while (!source->hasEnded()) {
-        bool result = insert(source->get());
-        if (!result) return make_pair(false, count);
-        count++;
+        const ValueArray& values = *source->get().record;
+        batch.resize((rows.size() + 1) * recordSize);
+        char* out = batch.data() + rows.size() * recordSize;
+        auto varData = schema.encode(values, out);
+        if (!varData.empty())
+            schema.setBlobId(out, blobManager.addBlob(varData));
+        else if (schema.hasVarLenData)
+            schema.setBlobId(out, NULL32);
+        rows.push_back(values);
         source->advance();
+
+        if (rows.size() == batchRows || source->hasEnded()) {
+            if (!insertBatch(batch, rows)) return make_pair(false, count);
+            count += (int)rows.size();
+            batch.clear();
+            rows.clear();
+        }
     }
     return make_pair(true, count);
 }
@@ -592,13 +1009,13 @@ pair<bool, int> Deleter::deleteAll() {
             blobManager.deleteBlob(blob);
         }
         bool result = dataFile.deleteRecord(p.first);
-        if (result) return make_pair(false, count);
+        if (!result) return make_pair(false, count);
         count++;
 
         for (auto& index : indexFiles) {
             ValueArray keyValues = index.getKeySchema().narrow(p.second);
-            auto keys = index.getKeySchema().encode(keyValues);
-            index.deleteKey(keys.first, p.first);
+            auto keys = index.getKeySchema().encodeKey(keyValues);
+            index.deleteKey(keys, p.first);
         }
     }
     return make_pair(true, count);
@@ -653,12 +1070,12 @@ pair<bool, int> Updater::updateAll() {
     for (uint16_t indexId : affectedIndexes) {
         const Schema& keySchema = sysMan.getIndexSchema(tableId, indexId);
         for (const auto& p : data) {
-            auto oldKeys = keySchema.encode(keySchema.narrow(p.second)).first;
+            auto oldKeys = keySchema.encodeKey(keySchema.narrow(p.second));
             indexFiles[j].deleteKey(oldKeys, p.first);
         }
         int i = 0;
         for (const auto& p : data) {
-            auto newKeys = keySchema.encode(keySchema.narrow(newData[i])).first;
+            auto newKeys = keySchema.encodeKey(keySchema.narrow(newData[i]));
             if (!indexFiles[j].addKey(newKeys, p.first)) {
                 result = false;
                 break;
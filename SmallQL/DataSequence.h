@@ -54,12 +54,31 @@ private:
     BlobManager& blobManager;
     IndexFile::const_iterator iter;
     const Schema& schema;
-    ValueArray from, to;
-    bool incFrom, incTo;
+    IndexFile::KeyBound from, to;
     unique_ptr<ValueArray> recordData;
+    void update();
 public:
     TableIndexScanDS(const Schema& schema, DataFile& data, IndexFile& index, BlobManager& blobManager,
         ValueArray from, ValueArray to, bool incFrom, bool incTo);
+    // Moves the scan to another range, it starts from the next reset
+    void setRange(const ValueArray& from, const ValueArray& to, bool incFrom, bool incTo);
+    virtual void reset();
+    virtual void advance();
+    virtual bool hasEnded() const;
+};
+
+// Reads the rows straight from the index keys, columns outside the index stay null
+class IndexOnlyScanDS : public DataSequence {
+private:
+    IndexFile& index;
+    IndexFile::const_iterator iter;
+    const Schema& keySchema;
+    IndexFile::KeyBound from, to;
+    unique_ptr<ValueArray> recordData;
+    void update();
+public:
+    IndexOnlyScanDS(const Schema& schema, const Schema& keySchema, IndexFile& index,
+        ValueArray from, ValueArray to, bool incFrom, bool incTo);
     virtual void reset();
     virtual void advance();
     virtual bool hasEnded() const;
@@ -174,6 +193,108 @@ public:
     virtual bool hasEnded() const;
 };
 
+// Builds a hash table on the right input and probes it with the left one, emits rows
+// in the same order as CondJoinDS: matches per left row, then the unmatched right rows
+class HashJoinDS : public DataSequence {
+private:
+    JoinType joinType;
+    DataSequence* left;
+    DataSequence* right;
+    vector<pair<uint16_t, uint16_t>> keys;
+    unique_ptr<QConditionNode> cond;
+    unique_ptr<CondCheckerVisitor> visitor;
+
+    unique_ptr<ValueArray> recordData;
+    int offset;
+    bool isLeftJoin, isRightJoin;
+
+    // Right rows chained per bucket in input order
+    vector<ValueArray> rightRows;
+    vector<int> buckets, bucketTails, nextRow;
+    size_t bucketMask;
+    bool hasBeenBuilt;
+    vector<bool> rightMatched;
+
+    int probeRow;
+    bool leftMatched;
+    bool rightNullWalk;
+    int rightNullIndex;
+    bool ended;
+
+    size_t hashKeys(const ValueArray& row, bool isLeft) const;
+    void build();
+    void startLeft();
+    void findNext();
+public:
+    HashJoinDS(const IntermediateType& type, DataSequence* left, DataSequence* right, JoinType joinType,
+        vector<pair<uint16_t, uint16_t>> keys, unique_ptr<QConditionNode> cond);
+    virtual void reset();
+    virtual void advance();
+    virtual bool hasEnded() const;
+};
+
+// Looks every left row up in an index of the right table by its lookup columns
+class IndexJoinDS : public DataSequence {
+private:
+    JoinType joinType;
+    DataSequence* left;
+    TableIndexScanDS* right;
+    vector<pair<uint16_t, uint16_t>> keys;
+    vector<uint16_t> lookupColumns;
+    ValueArray from, to;
+    unique_ptr<QConditionNode> cond;
+    unique_ptr<CondCheckerVisitor> visitor;
+
+    unique_ptr<ValueArray> recordData;
+    int offset;
+    bool leftMatched;
+    bool ended;
+
+    void startLeft();
+    void findNext();
+public:
+    IndexJoinDS(const IntermediateType& type, DataSequence* left, TableIndexScanDS* right, JoinType joinType,
+        vector<pair<uint16_t, uint16_t>> keys, vector<uint16_t> lookupColumns, int keySize,
+        unique_ptr<QConditionNode> cond);
+    virtual void reset();
+    virtual void advance();
+    virtual bool hasEnded() const;
+};
+
+// Joins two sources ordered on the first key in one pass, buffering only the right rows of the current key
+class MergeJoinDS : public DataSequence {
+private:
+    JoinType joinType;
+    DataSequence* left;
+    DataSequence* right;
+    vector<pair<uint16_t, uint16_t>> keys;
+    unique_ptr<QConditionNode> cond;
+    unique_ptr<CondCheckerVisitor> visitor;
+
+    unique_ptr<ValueArray> recordData;
+    int offset;
+    bool isLeftJoin, isRightJoin;
+
+    vector<ValueArray> run;
+    vector<bool> runMatched;
+    Value runKey;
+    int runIndex;
+    // Right rows without a match, waiting to be emitted with a null left side
+    vector<ValueArray> unmatchedRight;
+    bool leftMatched;
+    bool ended;
+
+    void closeRun();
+    void startLeft();
+    void findNext();
+public:
+    MergeJoinDS(const IntermediateType& type, DataSequence* left, DataSequence* right, JoinType joinType,
+        vector<pair<uint16_t, uint16_t>> keys, unique_ptr<QConditionNode> cond);
+    virtual void reset();
+    virtual void advance();
+    virtual bool hasEnded() const;
+};
+
 class SorterDS : public DataSequence {
 private:
     DataSequence* source;
@@ -209,6 +330,7 @@ private:
     const Schema& schema;
     BlobManager& blobManager;
     vector<IndexFile> indexFiles;
+    bool insertBatch(const vector<char>& batch, const vector<ValueArray>& rows);
 public:
     Inserter(TransactionManager& trMan, const SystemInfoManager& sysMan, BlobManager& blobManager, uint16_t tableId);
     bool insert(RecordPtr record);
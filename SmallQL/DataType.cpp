@@ -4,6 +4,8 @@
 #include <algorithm>
 #include <assert.h>
 #include <sstream>
+#include <cmath>
+#include <functional>
 
 Value::~Value() {
     if (type == ValueType::String)
@@ -202,6 +204,63 @@ int compareValue(const Value& a, const Value& b) {
     }
 }
 
+// Integers hash as doubles since they compare equal to them
+size_t hashValue(const Value& v) {
+    switch (v.type)
+    {
+    case ValueType::Integer:
+        return hash<double>()((double)v.intVal);
+    case ValueType::Double:
+        return hash<double>()(v.doubleVal == 0 ? 0.0 : v.doubleVal);
+    case ValueType::String:
+        return hash<string>()(v.stringVal);
+    case ValueType::Datetime: {
+        const Datetime& d = v.datetimeVal;
+        int64_t x = ((((int64_t)d.year * 13 + d.month) * 32 + d.day) * 24 + d.hour) * 3600 + d.minute * 60 + d.second;
+        return hash<int64_t>()(x);
+    }
+    default:
+        return 0;
+    }
+}
+
+// Key encodings keep numbers big-endian so that they compare bytewise
+static void writeBigEndian(uint64_t x, int bytes, char* out) {
+    for (int i = bytes - 1; i >= 0; i--) {
+        out[i] = (char)(x & 0xFF);
+        x >>= 8;
+    }
+}
+static uint64_t readBigEndian(const char* data, int bytes) {
+    uint64_t x = 0;
+    for (int i = 0; i < bytes; i++)
+        x = x << 8 | (uint8_t)data[i];
+    return x;
+}
+
+// Doubles are rounded towards the range, values past the type limits are clamped
+static BoundFit fitIntegerBound(Value& val, bool isLower, int64_t low, int64_t high) {
+    BoundFit fit = BoundFit::Exact;
+    if (val.type == ValueType::Double) {
+        double rounded = isLower ? ceil(val.doubleVal) : floor(val.doubleVal);
+        if (rounded != val.doubleVal)
+            fit = BoundFit::Inclusive;
+        rounded = max((double)low - 1, min((double)high + 1, rounded));
+        val = Value((int64_t)rounded);
+    }
+    if (val.intVal < low) {
+        if (isLower) return BoundFit::Unbounded;
+        val = Value(low);
+        return BoundFit::Exclusive;
+    }
+    if (val.intVal > high) {
+        if (!isLower) return BoundFit::Unbounded;
+        val = Value(high);
+        return BoundFit::Exclusive;
+    }
+    return fit;
+}
+
 bool NullType::checkVal(Value val) const {
     return val.type == ValueType::Null;
 }
@@ -225,6 +284,18 @@ Value ByteType::decode(const char* data) const {
     result.intVal = *(int8_t*)data;
     return result;
 }
+void ByteType::encodeKey(Value val, char* out) const {
+    assert(checkVal(val));
+    *(uint8_t*)out = (uint8_t)val.intVal ^ 0x80;
+}
+Value ByteType::decodeKey(const char* data) const {
+    Value result(ValueType::Integer);
+    result.intVal = (int8_t)(*(uint8_t*)data ^ 0x80);
+    return result;
+}
+BoundFit ByteType::fitBound(Value& val, bool isLower) const {
+    return fitIntegerBound(val, isLower, INT8_MIN, INT8_MAX);
+}
 void ByteType::print(ostream& os) const {
     os << "BYTE";
 }
@@ -241,6 +312,18 @@ Value ShortIntType::decode(const char* data) const {
     result.intVal = *(int16_t*)data;
     return result;
 }
+void ShortIntType::encodeKey(Value val, char* out) const {
+    assert(checkVal(val));
+    writeBigEndian((uint16_t)val.intVal ^ 0x8000, 2, out);
+}
+Value ShortIntType::decodeKey(const char* data) const {
+    Value result(ValueType::Integer);
+    result.intVal = (int16_t)(readBigEndian(data, 2) ^ 0x8000);
+    return result;
+}
+BoundFit ShortIntType::fitBound(Value& val, bool isLower) const {
+    return fitIntegerBound(val, isLower, INT16_MIN, INT16_MAX);
+}
 void ShortIntType::print(ostream& os) const {
     os << "SMALLINT";
 }
@@ -257,6 +340,18 @@ Value IntType::decode(const char* data) const {
     result.intVal = *(int32_t*)data;
     return result;
 }
+void IntType::encodeKey(Value val, char* out) const {
+    assert(checkVal(val));
+    writeBigEndian((uint32_t)val.intVal ^ 0x80000000u, 4, out);
+}
+Value IntType::decodeKey(const char* data) const {
+    Value result(ValueType::Integer);
+    result.intVal = (int32_t)(readBigEndian(data, 4) ^ 0x80000000u);
+    return result;
+}
+BoundFit IntType::fitBound(Value& val, bool isLower) const {
+    return fitIntegerBound(val, isLower, INT32_MIN, INT32_MAX);
+}
 void IntType::print(ostream& os) const {
     os << "INTEGER";
 }
@@ -276,6 +371,23 @@ Value DoubleType::decode(const char* data) const {
     result.doubleVal = *(double*)data;
     return result;
 }
+// Positive doubles get the sign bit set and negative ones are inverted as a whole
+void DoubleType::encodeKey(Value val, char* out) const {
+    assert(checkVal(val));
+    double x = val.type == ValueType::Double ? val.doubleVal : (double)val.intVal;
+    if (x == 0) x = 0; // -0.0 and 0.0 are the same key
+    uint64_t bits;
+    memcpy(&bits, &x, 8);
+    bits = bits >> 63 ? ~bits : bits | 1ull << 63;
+    writeBigEndian(bits, 8, out);
+}
+Value DoubleType::decodeKey(const char* data) const {
+    uint64_t bits = readBigEndian(data, 8);
+    bits = bits >> 63 ? bits & ~(1ull << 63) : ~bits;
+    Value result(ValueType::Double);
+    memcpy(&result.doubleVal, &bits, 8);
+    return result;
+}
 void DoubleType::print(ostream& os) const {
     os << "DOUBLE";
 }
@@ -303,6 +415,15 @@ Value DatetimeType::decode(const char* data) const {
     result.datetimeVal.second = *(uint8_t*)(data + 6);
     return result;
 }
+void DatetimeType::encodeKey(Value val, char* out) const {
+    encode(val, out);
+    writeBigEndian(val.datetimeVal.year, 2, out);
+}
+Value DatetimeType::decodeKey(const char* data) const {
+    Value result = decode(data);
+    result.datetimeVal.year = (uint16_t)readBigEndian(data, 2);
+    return result;
+}
 void DatetimeType::print(ostream& os) const {
     os << "DATETIME";
 }
@@ -323,6 +444,43 @@ Value VarCharType::decode(const char* data) const {
     result.stringVal = string(data + 2, size);
     return result;
 }
+// Content zero padded to the full width with the length after it,
+// so a string sorts before every longer one it is a prefix of
+void VarCharType::encodeKey(Value val, char* out) const {
+    assert(checkVal(val));
+    size_t length = val.stringVal.size();
+    memcpy(out, val.stringVal.c_str(), length);
+    memset(out + length, 0, maxSize - length);
+    writeBigEndian(length, 2, out + maxSize);
+}
+Value VarCharType::decodeKey(const char* data) const {
+    Value result(ValueType::String);
+    uint16_t size = (uint16_t)readBigEndian(data + maxSize, 2);
+    assert(size <= maxSize);
+    result.stringVal = string(data, size);
+    return result;
+}
+// Longer strings are cut to the width, the cut one is below the original
+BoundFit VarCharType::fitBound(Value& val, bool isLower) const {
+    if (val.type != ValueType::String || val.stringVal.size() <= maxSize)
+        return BoundFit::Exact;
+    val.stringVal.resize(maxSize);
+    return isLower ? BoundFit::Exclusive : BoundFit::Inclusive;
+}
+// Content up to a zero terminator, strings never hold zero bytes themselves
+uint32_t VarCharType::packKey(const char* key, char* out) const {
+    uint16_t length = (uint16_t)readBigEndian(key + maxSize, 2);
+    memcpy(out, key, length);
+    out[length] = 0x00;
+    return length + 1;
+}
+uint32_t VarCharType::unpackKey(const char* packed, char* out) const {
+    size_t length = strnlen(packed, maxSize);
+    memcpy(out, packed, length);
+    memset(out + length, 0, maxSize - length);
+    writeBigEndian(length, 2, out + maxSize);
+    return length + 1;
+}
 void VarCharType::print(ostream& os) const {
     os << "VARCHAR(" << maxSize << ")";
 }
@@ -392,10 +550,12 @@ void Schema::updateData(bool preserveIds) {
     totalNullBytes = (totalNullBits + 7) / 8;
 
     uint32_t offset = totalNullBytes;
+    keySize = 0;
     for (int i = 0; i < this->columns.size(); i++) {
         if (is<VariableLengthType>(this->columns[i].type)) continue;
         this->columns[i].offset = offset;
         offset += this->columns[i].type->getSize();
+        keySize += this->columns[i].type->getSize() + (this->columns[i].canBeNull ? 1 : 0);
     }
     size = offset;
     if (hasVarLenData) {
@@ -476,6 +636,97 @@ ValueArray Schema::decode(const char* data, const char* varData) const {
     }
     return result;
 }
+void Schema::encodeKey(const ValueArray& values, char* out) const {
+    for (int i = 0; i < columns.size(); i++) {
+        const auto& column = columns[i];
+        if (is<VariableLengthType>(column.type)) continue;
+        if (column.canBeNull)
+            *out++ = values[i].type == ValueType::Null ? 0x00 : 0x01;
+        if (values[i].type == ValueType::Null)
+            memset(out, 0, column.type->getSize());
+        else
+            column.type->encodeKey(values[i], out);
+        out += column.type->getSize();
+    }
+}
+ValueArray Schema::decodeKey(const char* data) const {
+    ValueArray result(columns.size());
+    for (int i = 0; i < columns.size(); i++) {
+        const auto& column = columns[i];
+        if (is<VariableLengthType>(column.type)) continue;
+        bool isNull = column.canBeNull && *data++ == 0x00;
+        if (!isNull)
+            result[i] = column.type->decodeKey(data);
+        data += column.type->getSize();
+    }
+    return result;
+}
+uint32_t Schema::encodeKeyBound(const ValueArray& values, bool isLower, bool& inclusive, char* out) const {
+    char* start = out;
+    for (int i = 0; i < values.size() && i < columns.size(); i++) {
+        const auto& column = columns[i];
+        Value val = values[i];
+        if (val.type == ValueType::MinVal || val.type == ValueType::MaxVal || is<VariableLengthType>(column.type))
+            break;
+        BoundFit fit = BoundFit::Exact;
+        if (val.type != ValueType::Null)
+            fit = column.type->fitBound(val, isLower);
+        else if (!column.canBeNull) // Null sorts below every value of the column
+            fit = isLower ? BoundFit::Unbounded : BoundFit::Exclusive;
+        if (fit == BoundFit::Unbounded) {
+            inclusive = true;
+            break;
+        }
+
+        if (column.canBeNull)
+            *out++ = val.type == ValueType::Null ? 0x00 : 0x01;
+        if (val.type == ValueType::Null)
+            memset(out, 0, column.type->getSize());
+        else
+            column.type->encodeKey(val, out);
+        out += column.type->getSize();
+        if (fit != BoundFit::Exact) {
+            inclusive = fit == BoundFit::Inclusive;
+            break;
+        }
+    }
+    if (out == start) inclusive = true;
+    return out - start;
+}
+uint32_t Schema::packKey(const char* key, char* out, uint32_t length) const {
+    const char* end = key + length;
+    char* start = out;
+    for (int i = 0; i < columns.size() && key < end; i++) {
+        const auto& column = columns[i];
+        if (is<VariableLengthType>(column.type)) continue;
+        if (column.canBeNull) {
+            *out++ = *key++;
+            if (out[-1] == 0x00) {
+                key += column.type->getSize();
+                continue;
+            }
+        }
+        out += column.type->packKey(key, out);
+        key += column.type->getSize();
+    }
+    return out - start;
+}
+void Schema::unpackKey(const char* packed, char* out) const {
+    for (int i = 0; i < columns.size(); i++) {
+        const auto& column = columns[i];
+        if (is<VariableLengthType>(column.type)) continue;
+        if (column.canBeNull) {
+            *out++ = *packed;
+            if (*packed++ == 0x00) {
+                memset(out, 0, column.type->getSize());
+                out += column.type->getSize();
+                continue;
+            }
+        }
+        packed += column.type->unpackKey(packed, out);
+        out += column.type->getSize();
+    }
+}
 uint32_t Schema::decodeBlobId(const char* data) const {
     auto ptr = data + varLenOffset;
     return *(uint32_t*)ptr;
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cstdint>
+#include <cstring>
 #include <vector>
 #include <set>
 #include <map>
@@ -59,6 +60,16 @@ using ValueArray = vector<Value>;
 
 ostream& operator<<(ostream& os, const ValueArray& values);
 int compareValue(const Value& a, const Value& b);
+// Values equal by compareValue hash the same
+size_t hashValue(const Value& v);
+
+// How a range bound fits into a column type, see DataType::fitBound
+enum class BoundFit {
+    Exact,      // Encoded as is
+    Inclusive,  // Rounded towards the range, the bound ends here and includes the value
+    Exclusive,  // Clamped to the type limit, the bound ends here and excludes the value
+    Unbounded   // The bound doesn't restrict this column and ends before it
+};
 
 class DataType {
 protected:
@@ -69,6 +80,15 @@ public:
     virtual bool checkVal(Value val) const = 0;
     virtual void encode(Value val, char* out) const = 0;
     virtual Value decode(const char* data) const = 0;
+    // Index key form, byte order of the encoded values matches compareValue
+    virtual void encodeKey(Value val, char* out) const { encode(val, out); }
+    virtual Value decodeKey(const char* data) const { return decode(data); }
+    // Fits a range bound value into the type, isLower tells which end of the range it is
+    virtual BoundFit fitBound(Value&, bool) const { return BoundFit::Exact; }
+    // Stored form of an encoded key value, byte order is kept and no value packs into a prefix of another
+    virtual uint32_t packKey(const char* key, char* out) const { memcpy(out, key, size); return size; }
+    // Restores the encoded value, returns the length of the packed one
+    virtual uint32_t unpackKey(const char* packed, char* out) const { memcpy(out, packed, size); return size; }
     virtual void print(ostream& os) const = 0;
     friend ostream& operator<<(ostream& os, const DataType& t);
     string toString() const;
@@ -123,14 +143,18 @@ struct Schema {
     int totalNullBits;
     int totalNullBytes;
     int size;
+    int keySize;
     bool hasVarLenData;
     int varLenOffset;
-    Schema() : columns(), totalNullBits(0), totalNullBytes(0), size(0), hasVarLenData(false), varLenOffset(0) {}
+    Schema() : columns(), totalNullBits(0), totalNullBytes(0), size(0), keySize(0), hasVarLenData(false), varLenOffset(0) {}
     Schema(vector<SchemaEntry> columns);
     void updateData(bool preserveIds);
     inline uint32_t getSize() const {
         return size;
     };
+    inline uint32_t getKeySize() const {
+        return keySize;
+    };
     bool checkVal(ValueArray values) const;
     vector<char> encode(ValueArray values, char* out) const;
     inline pair<vector<char>, vector<char>> encode(ValueArray values) const {
@@ -151,6 +175,25 @@ struct Schema {
     inline int compare(const vector<char>& a, const vector<char>& b) const {
         return compare(a.data(), b.data());
     };
+    // Index keys: every column in order, nullable ones after a 0x00/0x01 null flag,
+    // so that memcmp on two keys gives the same order as compare
+    void encodeKey(const ValueArray& values, char* out) const;
+    inline vector<char> encodeKey(const ValueArray& values) const {
+        vector<char> result(getKeySize());
+        encodeKey(values, result.data());
+        return result;
+    }
+    ValueArray decodeKey(const char* data) const;
+    // Encodes the leading values of a range bound up to the first MinVal or MaxVal, returns its length
+    uint32_t encodeKeyBound(const ValueArray& values, bool isLower, bool& inclusive, char* out) const;
+    // Packed keys are what index pages store: null values and string padding are dropped,
+    // memcmp order is kept and a key never packs into a prefix of another one.
+    // Packs the leading columns covering length bytes of an encoded key, returns the packed length
+    uint32_t packKey(const char* key, char* out, uint32_t length) const;
+    inline uint32_t packKey(const char* key, char* out) const {
+        return packKey(key, out, keySize);
+    }
+    void unpackKey(const char* packed, char* out) const;
     void addColumn(SchemaEntry entry);
     Schema primaryKeySubschema() const;
     ValueArray narrow(const ValueArray& values) const;
@@ -167,6 +210,9 @@ public:
     bool checkVal(Value val) const;
     void encode(Value val, char* out) const;
     Value decode(const char* data) const;
+    void encodeKey(Value val, char* out) const;
+    Value decodeKey(const char* data) const;
+    BoundFit fitBound(Value& val, bool isLower) const;
     void print(ostream& os) const;
 };
 
@@ -177,6 +223,9 @@ public:
     bool checkVal(Value val) const;
     void encode(Value val, char* out) const;
     Value decode(const char* data) const;
+    void encodeKey(Value val, char* out) const;
+    Value decodeKey(const char* data) const;
+    BoundFit fitBound(Value& val, bool isLower) const;
     void print(ostream& os) const;
 };
 
@@ -187,6 +236,9 @@ public:
     bool checkVal(Value val) const;
     void encode(Value val, char* out) const;
     Value decode(const char* data) const;
+    void encodeKey(Value val, char* out) const;
+    Value decodeKey(const char* data) const;
+    BoundFit fitBound(Value& val, bool isLower) const;
     void print(ostream& os) const;
 };
 
@@ -197,6 +249,8 @@ public:
     bool checkVal(Value val) const;
     void encode(Value val, char* out) const;
     Value decode(const char* data) const;
+    void encodeKey(Value val, char* out) const;
+    Value decodeKey(const char* data) const;
     void print(ostream& os) const;
 };
 
@@ -207,6 +261,8 @@ public:
     bool checkVal(Value val) const;
     void encode(Value val, char* out) const;
     Value decode(const char* data) const;
+    void encodeKey(Value val, char* out) const;
+    Value decodeKey(const char* data) const;
     void print(ostream& os) const;
 };
 
@@ -219,6 +275,11 @@ public:
     bool checkVal(Value val) const;
     void encode(Value val, char* out) const;
     Value decode(const char* data) const;
+    void encodeKey(Value val, char* out) const;
+    Value decodeKey(const char* data) const;
+    BoundFit fitBound(Value& val, bool isLower) const;
+    uint32_t packKey(const char* key, char* out) const;
+    uint32_t unpackKey(const char* packed, char* out) const;
     void print(ostream& os) const;
 };
 
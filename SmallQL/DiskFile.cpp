@@ -0,0 +1,266 @@
+#include "DiskFile.h"
+#include "PageManager.h"
+#include <iostream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <malloc.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <cerrno>
+#include <cstdlib>
+
+static const size_t MAX_IOVECS = 1024;
+#endif
+
+#ifdef _WIN32
+
+DiskFile::DiskFile(string filename, bool directIO) : directIO(directIO) {
+    DWORD flags = FILE_ATTRIBUTE_NORMAL;
+    if (directIO)
+        flags |= FILE_FLAG_NO_BUFFERING | FILE_FLAG_WRITE_THROUGH;
+    handle = CreateFileA(filename.c_str(), GENERIC_READ | GENERIC_WRITE,
+        FILE_SHARE_READ, NULL, OPEN_ALWAYS, flags, NULL);
+    if (handle == INVALID_HANDLE_VALUE && directIO) {
+        this->directIO = false;
+        handle = CreateFileA(filename.c_str(), GENERIC_READ | GENERIC_WRITE,
+            FILE_SHARE_READ, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    }
+    if (handle == INVALID_HANDLE_VALUE) {
+        cout << "Cannot open " << filename << "!" << endl;
+        exit(1);
+    }
+}
+
+DiskFile::~DiskFile() {
+    CloseHandle(handle);
+}
+
+size_t DiskFile::read(uint64_t offset, char* buffer, size_t size) const {
+    size_t total = 0;
+    while (total < size) {
+        OVERLAPPED o = {};
+        o.Offset = (DWORD)(offset + total);
+        o.OffsetHigh = (DWORD)((offset + total) >> 32);
+        DWORD count = 0;
+        if (!ReadFile(handle, buffer + total, (DWORD)(size - total), &count, &o)) {
+            if (GetLastError() == ERROR_HANDLE_EOF) break;
+            cout << "Disk read error!" << endl;
+            exit(1);
+        }
+        if (count == 0) break;
+        total += count;
+    }
+    return total;
+}
+
+void DiskFile::write(uint64_t offset, const char* buffer, size_t size) const {
+    size_t total = 0;
+    while (total < size) {
+        OVERLAPPED o = {};
+        o.Offset = (DWORD)(offset + total);
+        o.OffsetHigh = (DWORD)((offset + total) >> 32);
+        DWORD count = 0;
+        if (!WriteFile(handle, buffer + total, (DWORD)(size - total), &count, &o)) {
+            cout << "Disk write error!" << endl;
+            exit(1);
+        }
+        total += count;
+    }
+}
+
+void DiskFile::write(uint64_t offset, const vector<const char*>& buffers, size_t bufferSize) const {
+    for (size_t i = 0; i < buffers.size(); i++)
+        write(offset + i * bufferSize, buffers[i], bufferSize);
+}
+
+void DiskFile::sync() const {
+    if (!FlushFileBuffers(handle)) {
+        cout << "Disk sync error!" << endl;
+        exit(1);
+    }
+}
+
+uint64_t DiskFile::size() const {
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(handle, &size)) return 0;
+    return size.QuadPart;
+}
+
+void DiskFile::truncate(uint64_t size) const {
+    LARGE_INTEGER position;
+    position.QuadPart = size;
+    SetFilePointerEx(handle, position, NULL, FILE_BEGIN);
+    SetEndOfFile(handle);
+}
+
+void DiskFile::prefetch(uint64_t offset, size_t size) const {}
+
+char* DiskFile::map(uint64_t offset, size_t size) const {
+    return nullptr;
+}
+
+void DiskFile::unmap(char* address, size_t size) {}
+
+void DiskFile::advise(char* address, size_t size, AccessPattern pattern) {}
+
+char* DiskFile::allocateBuffer(size_t size) {
+    return (char*)_aligned_malloc(size, PAGE_SIZE);
+}
+
+void DiskFile::freeBuffer(char* buffer) {
+    _aligned_free(buffer);
+}
+
+#else
+
+DiskFile::DiskFile(string filename, bool directIO) : directIO(directIO) {
+    int flags = O_RDWR | O_CREAT;
+#ifdef O_DIRECT
+    if (directIO) {
+        fd = open(filename.c_str(), flags | O_DIRECT, 0644);
+        // Some filesystems (tmpfs for one) refuse O_DIRECT
+        if (fd < 0 && errno == EINVAL) {
+            this->directIO = false;
+            fd = open(filename.c_str(), flags, 0644);
+        }
+    }
+    else
+        fd = open(filename.c_str(), flags, 0644);
+#else
+    this->directIO = false;
+    fd = open(filename.c_str(), flags, 0644);
+#endif
+    if (fd < 0) {
+        cout << "Cannot open " << filename << "!" << endl;
+        exit(1);
+    }
+}
+
+DiskFile::~DiskFile() {
+    close(fd);
+}
+
+size_t DiskFile::read(uint64_t offset, char* buffer, size_t size) const {
+    size_t total = 0;
+    while (total < size) {
+        ssize_t count = pread(fd, buffer + total, size - total, offset + total);
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            cout << "Disk read error!" << endl;
+            exit(1);
+        }
+        if (count == 0) break;
+        total += count;
+    }
+    return total;
+}
+
+void DiskFile::write(uint64_t offset, const char* buffer, size_t size) const {
+    size_t total = 0;
+    while (total < size) {
+        ssize_t count = pwrite(fd, buffer + total, size - total, offset + total);
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            cout << "Disk write error!" << endl;
+            exit(1);
+        }
+        total += count;
+    }
+}
+
+void DiskFile::write(uint64_t offset, const vector<const char*>& buffers, size_t bufferSize) const {
+    size_t done = 0;
+    vector<iovec> iov;
+    while (done < buffers.size()) {
+        size_t n = min(buffers.size() - done, MAX_IOVECS);
+        iov.resize(n);
+        for (size_t i = 0; i < n; i++)
+            iov[i] = iovec{ (void*)buffers[done + i], bufferSize };
+        ssize_t count = pwritev(fd, iov.data(), n, offset + done * bufferSize);
+        if (count <= 0) {
+            if (count < 0 && errno == EINTR) continue;
+            cout << "Disk write error!" << endl;
+            exit(1);
+        }
+        size_t written = count / bufferSize;
+        size_t partial = count % bufferSize;
+        if (partial) {
+            uint64_t pos = offset + (done + written) * bufferSize;
+            write(pos + partial, buffers[done + written] + partial, bufferSize - partial);
+            written++;
+        }
+        done += written;
+    }
+}
+
+void DiskFile::sync() const {
+    while (true) {
+#ifdef __linux__
+        int result = fdatasync(fd);
+#else
+        int result = fsync(fd);
+#endif
+        if (result == 0) return;
+        if (errno == EINTR) continue;
+        cout << "Disk sync error!" << endl;
+        exit(1);
+    }
+}
+
+uint64_t DiskFile::size() const {
+    struct stat st;
+    if (fstat(fd, &st) != 0) return 0;
+    return st.st_size;
+}
+
+void DiskFile::truncate(uint64_t size) const {
+    if (ftruncate(fd, size) != 0) {
+        cout << "Cannot truncate file!" << endl;
+        exit(1);
+    }
+}
+
+void DiskFile::prefetch(uint64_t offset, size_t size) const {
+    // Direct I/O never goes through the OS cache
+    if (directIO) return;
+#ifdef POSIX_FADV_WILLNEED
+    posix_fadvise(fd, offset, size, POSIX_FADV_WILLNEED);
+#endif
+}
+
+char* DiskFile::map(uint64_t offset, size_t size) const {
+    void* p = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, offset);
+    return p == MAP_FAILED ? nullptr : (char*)p;
+}
+
+void DiskFile::unmap(char* address, size_t size) {
+    munmap(address, size);
+}
+
+void DiskFile::advise(char* address, size_t size, AccessPattern pattern) {
+    int advice = MADV_NORMAL;
+    if (pattern == AccessPattern::Sequential) advice = MADV_SEQUENTIAL;
+    else if (pattern == AccessPattern::Random) advice = MADV_RANDOM;
+    madvise(address, size, advice);
+}
+
+char* DiskFile::allocateBuffer(size_t size) {
+    void* p = nullptr;
+    if (posix_memalign(&p, PAGE_SIZE, size) != 0) {
+        cout << "Out of memory!" << endl;
+        exit(1);
+    }
+    return (char*)p;
+}
+
+void DiskFile::freeBuffer(char* buffer) {
+    free(buffer);
+}
+
+#endif
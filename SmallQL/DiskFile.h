@@ -0,0 +1,45 @@
+#pragma once
+
+#include "Common.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum class AccessPattern {
+    Normal, Sequential, Random
+};
+
+// Positional page I/O, safe to use from several threads at once
+class DiskFile {
+private:
+#ifdef _WIN32
+    void* handle;
+#else
+    int fd;
+#endif
+    bool directIO;
+public:
+    DiskFile(string filename, bool directIO = false);
+    ~DiskFile();
+    DiskFile(const DiskFile&) = delete;
+    DiskFile& operator=(const DiskFile&) = delete;
+
+    inline bool isDirect() const { return directIO; }
+
+    size_t read(uint64_t offset, char* buffer, size_t size) const;
+    void write(uint64_t offset, const char* buffer, size_t size) const;
+    void write(uint64_t offset, const vector<const char*>& buffers, size_t bufferSize) const;
+    void sync() const;
+    uint64_t size() const;
+    void truncate(uint64_t size) const;
+    // Starts reading the range into the OS cache in the background
+    void prefetch(uint64_t offset, size_t size) const;
+
+    // Read-only shared mapping, nullptr if mapping is not supported
+    char* map(uint64_t offset, size_t size) const;
+    static void unmap(char* address, size_t size);
+    static void advise(char* address, size_t size, AccessPattern pattern);
+
+    static char* allocateBuffer(size_t size);
+    static void freeBuffer(char* buffer);
+};
@@ -27,9 +27,9 @@ public:
     virtual void visitUnionQNode(UnionQNode& n);
     virtual void visitJoinQNode(JoinQNode& n);
     virtual void visitSorterQNode(SorterQNode& n);
-    virtual void visitGroupifierQNode(GroupifierQNode& n);
     virtual void visitAggrFuncProjectionQNode(AggrFuncProjectionQNode& n);
     virtual void visitDegroupifierQNode(DegroupifierQNode& n);
+    virtual void visitHashAggregateQNode(HashAggregateQNode& n);
     virtual void visitSelectorNode(SelectorNode& n);
     virtual void visitInserterNode(InserterNode& n);
     virtual void visitDeleterNode(DeleterNode& n);
@@ -52,12 +52,20 @@ void PreparerVisitor::visitReadTableQNode(ReadTableQNode& n) {
 }
 
 void PreparerVisitor::visitReadTableIndexScanQNode(ReadTableIndexScanQNode& n) {
-    DataFile& data = exec->addDataFile(n.tableId, n.tableSchema);
     IndexFile& index = exec->addIndexFile(n.tableId, n.indexId, n.keySchema, n.isUnique);
-    auto seq = make_unique<TableIndexScanDS>(
-        n.tableSchema, data, index, exec->blobManager,
-        n.from, n.to, n.incFrom, n.incTo);
-    exec->sequences.push_back(move(seq));
+    if (n.isCovering) {
+        auto seq = make_unique<IndexOnlyScanDS>(
+            n.tableSchema, n.keySchema, index,
+            n.from, n.to, n.incFrom, n.incTo);
+        exec->sequences.push_back(move(seq));
+    }
+    else {
+        DataFile& data = exec->addDataFile(n.tableId, n.tableSchema);
+        auto seq = make_unique<TableIndexScanDS>(
+            n.tableSchema, data, index, exec->blobManager,
+            n.from, n.to, n.incFrom, n.incTo);
+        exec->sequences.push_back(move(seq));
+    }
     lastResult = exec->sequences.size() - 1;
 }
 
@@ -102,12 +110,38 @@ void PreparerVisitor::visitUnionQNode(UnionQNode& n) {
 void PreparerVisitor::visitJoinQNode(JoinQNode& n) {
     n.left->accept(this);
     DataSequence* newLeft = exec->sequences[lastResult].get();
+    if (n.method == JoinMethod::IndexLookup) {
+        // The right table is only read through the index, once per left row
+        auto table = convert<ReadTableQNode>(n.right);
+        DataFile& data = exec->addDataFile(table->tableId, table->tableSchema);
+        IndexFile& index = exec->addIndexFile(table->tableId, n.indexId, n.keySchema, n.isUnique);
+        ValueArray from(n.keySchema.columns.size(), Value(ValueType::MinVal));
+        ValueArray to(n.keySchema.columns.size(), Value(ValueType::MaxVal));
+        auto scan = make_unique<TableIndexScanDS>(
+            table->tableSchema, data, index, exec->blobManager,
+            from, to, true, true);
+        TableIndexScanDS* inner = scan.get();
+        exec->sequences.push_back(move(scan));
+        auto seq = make_unique<IndexJoinDS>(n.type, newLeft, inner, n.joinType,
+            n.equiKeys, n.lookupColumns, n.keySchema.columns.size(), move(n.on));
+        exec->sequences.push_back(move(seq));
+        lastResult = exec->sequences.size() - 1;
+        return;
+    }
     n.right->accept(this);
     DataSequence* newRight = exec->sequences[lastResult].get();
     if (n.joinType == JoinType::Cross) {
         auto seq = make_unique<CrossJoinDS>(n.type, newLeft, newRight);
         exec->sequences.push_back(move(seq));
     }
+    else if (n.method == JoinMethod::Merge) {
+        auto seq = make_unique<MergeJoinDS>(n.type, newLeft, newRight, n.joinType, n.equiKeys, move(n.on));
+        exec->sequences.push_back(move(seq));
+    }
+    else if (n.method == JoinMethod::Hash) {
+        auto seq = make_unique<HashJoinDS>(n.type, newLeft, newRight, n.joinType, n.equiKeys, move(n.on));
+        exec->sequences.push_back(move(seq));
+    }
     else {
         auto seq = make_unique<CondJoinDS>(n.type, newLeft, newRight, n.joinType, move(n.on));
         exec->sequences.push_back(move(seq));
@@ -124,24 +158,14 @@ void PreparerVisitor::visitSorterQNode(SorterQNode& n) {
     lastResult = exec->sequences.size() - 1;
 }
 
-void PreparerVisitor::visitGroupifierQNode(GroupifierQNode& n) {
-    n.source->accept(this);
-    uint32_t sourceId = lastResult;
-    auto seq = make_unique<GroupifierDS>(
-        n.type, n.groupPlan, exec->sequences[sourceId].get());
-    exec->groupSequences.push_back(move(seq));
-    lastResult = exec->groupSequences.size() - 1;
-}
-
 void PreparerVisitor::visitAggrFuncProjectionQNode(AggrFuncProjectionQNode& n) {
     n.source->accept(this);
     uint32_t sourceId = lastResult;
-    auto source = exec->groupSequences[sourceId].get();
-    auto isGrouped = source->get().isGrouped;
+    auto isGrouped = n.groupPlan;
     for (int i = 0; i < n.funcs.size(); i++)
         isGrouped.push_back(true);
     auto seq = make_unique<AggregatorDS>(
-        n.type, isGrouped, source, move(n.funcs));
+        n.type, isGrouped, exec->sequences[sourceId].get(), move(n.funcs));
     exec->groupSequences.push_back(move(seq));
     lastResult = exec->groupSequences.size() - 1;
 }
@@ -155,6 +179,15 @@ void PreparerVisitor::visitDegroupifierQNode(DegroupifierQNode& n) {
     lastResult = exec->sequences.size() - 1;
 }
 
+void PreparerVisitor::visitHashAggregateQNode(HashAggregateQNode& n) {
+    n.source->accept(this);
+    uint32_t sourceId = lastResult;
+    auto seq = make_unique<HashAggregateDS>(
+        n.type, exec->sequences[sourceId].get(), n.groupPlan, move(n.funcs));
+    exec->sequences.push_back(move(seq));
+    lastResult = exec->sequences.size() - 1;
+}
+
 void PreparerVisitor::visitSelectorNode(SelectorNode& n) {
     exec->queryType = QueryType::Select;
     n.source->accept(this);
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "Common.h"
+#include <vector>
+
+const PageId EXTENT_PAGES = 64;
+
+// Free page bitmap, one 64-bit word covers exactly one extent
+class FreePageMap {
+private:
+    static const uint64_t FULL_EXTENT = NULL64;
+    vector<uint64_t> words;
+    PageId pageCount;
+    PageId freeCount;
+    // No extent below this one is completely free
+    size_t extentHint;
+public:
+    FreePageMap() : pageCount(0), freeCount(0), extentHint(0) {}
+
+    inline PageId size() const { return pageCount; }
+    inline PageId freePages() const { return freeCount; }
+    inline size_t extentCount() const { return words.size(); }
+    inline bool isFree(PageId id) const {
+        return id < pageCount && (words[id / EXTENT_PAGES] >> (id % EXTENT_PAGES) & 1);
+    }
+
+    void setFree(PageId id, bool free) {
+        uint64_t& word = words[id / EXTENT_PAGES];
+        uint64_t bit = 1ull << (id % EXTENT_PAGES);
+        if (((word & bit) != 0) == free) return;
+        if (free) {
+            word |= bit;
+            freeCount++;
+            if (word == FULL_EXTENT)
+                extentHint = min(extentHint, (size_t)(id / EXTENT_PAGES));
+        }
+        else {
+            word &= ~bit;
+            freeCount--;
+        }
+    }
+
+    // New pages start out used, grow() hands out whole free extents instead
+    void resize(PageId count) {
+        pageCount = count;
+        words.resize((count + EXTENT_PAGES - 1) / EXTENT_PAGES, 0);
+    }
+
+    // Appends free pages up to the next extent boundary plus one whole extent
+    PageId grow() {
+        PageId start = (pageCount + EXTENT_PAGES - 1) / EXTENT_PAGES * EXTENT_PAGES;
+        PageId old = pageCount;
+        resize(start + EXTENT_PAGES);
+        for (PageId i = old; i < pageCount; i++)
+            setFree(i, true);
+        return start;
+    }
+
+    // First free page after the given one in the same extent
+    PageId nextInExtent(PageId id) const {
+        if (id + 1 >= pageCount || (id + 1) % EXTENT_PAGES == 0) return NULL32;
+        uint64_t word = words[id / EXTENT_PAGES] >> (id % EXTENT_PAGES + 1);
+        if (word == 0) return NULL32;
+        return id + 1 + countTrailingZeros(word);
+    }
+
+    // First completely free extent starting at or after the given page
+    PageId findFreeExtent(PageId from) {
+        size_t first = (from + EXTENT_PAGES - 1) / EXTENT_PAGES;
+        if (first <= extentHint) {
+            for (; extentHint < words.size(); extentHint++) {
+                if (words[extentHint] == FULL_EXTENT)
+                    return (PageId)(extentHint * EXTENT_PAGES);
+            }
+            return NULL32;
+        }
+        for (size_t i = first; i < words.size(); i++) {
+            if (words[i] == FULL_EXTENT)
+                return (PageId)(i * EXTENT_PAGES);
+        }
+        return NULL32;
+    }
+
+    // First free page at or after the given one outside of the skipped extents
+    PageId findFree(PageId from, const vector<bool>& skip) const {
+        if (freeCount == 0) return NULL32;
+        for (size_t i = from / EXTENT_PAGES; i < words.size(); i++) {
+            uint64_t word = words[i];
+            if (i == from / EXTENT_PAGES)
+                word &= NULL64 << (from % EXTENT_PAGES);
+            if (word && !skip[i]) return (PageId)(i * EXTENT_PAGES) + countTrailingZeros(word);
+        }
+        return NULL32;
+    }
+
+    template<typename F>
+    void forEachFree(F f) const {
+        for (size_t i = 0; i < words.size(); i++) {
+            uint64_t word = words[i];
+            while (word) {
+                PageId bit = countTrailingZeros(word);
+                f((PageId)(i * EXTENT_PAGES) + bit);
+                word &= word - 1;
+            }
+        }
+    }
+};
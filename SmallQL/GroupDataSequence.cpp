@@ -2,45 +2,18 @@
 #include "QueryTree.h"
 #include "ComputerVisitor.h"
 
-GroupifierDS::GroupifierDS(const IntermediateType& type, vector<bool> isGrouped,
-    DataSequence* source) 
-    : source(source)
-    , data(make_unique<vector<ValueArray>>())
-    , GroupDataSequence(type, isGrouped) {
-    record.record = data.get();
-}
-void GroupifierDS::reset() {
-    source->reset();
-    data->clear();
-    ended = false;
-    update();
+static void makeAccumulators(const vector<AggrFuncQNode*>& aggrs, vector<unique_ptr<Accumulator>>& accumulators) {
+    accumulators.clear();
+    for (auto aggr : aggrs)
+        accumulators.push_back(makeAccumulator(*aggr));
 }
-void GroupifierDS::advance() {
-    data->clear();
-    if (source->hasEnded())
-        ended = true;
-    else
-        update();
-}
-bool GroupifierDS::hasEnded() const {
-    return ended;
-}
-void GroupifierDS::update() {
-    while (!source->hasEnded()) {
-        bool isEqual = true;
-        auto srcRec = source->get().record;
-        if (!data->empty()) {
-            for (int i = 0; i < srcRec->size(); i++) {
-                if (!record.isGrouped[i]) continue;
-                if (record.type.entries[i].compare((*srcRec)[i], data->back()[i]) != 0) {
-                    isEqual = false;
-                    break;
-                }
-            }
-        }
-        if (!isEqual) return;
-        data->push_back(*srcRec);
-        source->advance();
+
+static void accumulateRow(const IntermediateType& type, const ValueArray& row,
+        const vector<AggrFuncQNode*>& aggrs, vector<unique_ptr<Accumulator>>& accumulators) {
+    ComputerVisitor computer(type, &row);
+    for (int i = 0; i < aggrs.size(); i++) {
+        aggrs[i]->child->accept(&computer);
+        accumulators[i]->add(computer.getResult());
     }
 }
 
@@ -75,43 +48,126 @@ void DegroupifierDS::update() {
 
 
 AggregatorDS::AggregatorDS(const IntermediateType& type, vector<bool> isGrouped,
-    GroupDataSequence* source,
+    DataSequence* source,
     vector<unique_ptr<QScalarNode>> funcs)
     : source(source)
-    , funcs()
-    , data(make_unique<vector<ValueArray>>())
+    , funcs(move(funcs))
+    , ended(true)
     , GroupDataSequence(type, isGrouped) {
-    record.record = data.get();
-    for (auto& f : funcs)
-        this->funcs.push_back(move(f));
-    visitor = make_unique<GroupComputerVisitor>(type, record.record);
+    record.record = &group;
+    AggrCollectorVisitor collector(aggrs);
+    for (auto& f : this->funcs)
+        f->accept(&collector);
+    visitor = make_unique<AccumulatorComputerVisitor>(source->getType(), aggrs);
 }
+AggregatorDS::~AggregatorDS() {}
 void AggregatorDS::reset() {
     source->reset();
-    if (!source->hasEnded())
-        update();
+    ended = false;
+    update();
 }
 void AggregatorDS::advance() {
-    source->advance();
-    if (!source->hasEnded())
+    if (source->hasEnded())
+        ended = true;
+    else
         update();
 }
 bool AggregatorDS::hasEnded() const {
-    return source->hasEnded();
+    return ended;
 }
 void AggregatorDS::update() {
-    data->clear();
-    for (int i = 0; i < source->get().record->size(); i++)
-        data->push_back((*source->get().record)[i]);
-    visitor->updateRecord();
+    makeAccumulators(aggrs, accumulators);
+    group.assign(1, ValueArray());
+    ValueArray& firstRow = group[0];
+    // Aggregates over an empty source still give one row
+    if (source->hasEnded())
+        firstRow.assign(source->getType().entries.size(), Value(ValueType::Null));
+    else
+        firstRow = *source->get().record;
 
+    while (!source->hasEnded()) {
+        const ValueArray& row = *source->get().record;
+        bool isEqual = true;
+        for (int i = 0; i < row.size(); i++) {
+            if (!record.isGrouped[i]) continue;
+            if (record.type.entries[i].compare(row[i], firstRow[i]) != 0) {
+                isEqual = false;
+                break;
+            }
+        }
+        if (!isEqual) break;
+        accumulateRow(source->getType(), row, aggrs, accumulators);
+        source->advance();
+    }
+
+    visitor->setGroup(&firstRow, &accumulators);
     ValueArray results;
     for (int i = 0; i < funcs.size(); i++) {
         funcs[i]->accept(visitor.get());
         results.push_back(visitor->getResult());
     }
+    firstRow.insert(firstRow.end(), results.begin(), results.end());
+}
 
-    if (data->empty())
-        data->emplace_back(source->getType().entries.size(), Value(ValueType::Null));
-    (*data)[0].insert((*data)[0].end(), results.begin(), results.end());
+
+HashAggregateDS::HashAggregateDS(const IntermediateType& type, DataSequence* source,
+    const vector<bool>& groupPlan, vector<unique_ptr<QScalarNode>> funcs)
+    : source(source)
+    , funcs(move(funcs))
+    , recordData(make_unique<ValueArray>(type.entries.size()))
+    , index(0)
+    , hasBeenBuilt(false)
+    , DataSequence(type) {
+    record.record = recordData.get();
+    for (int i = 0; i < groupPlan.size(); i++)
+        if (groupPlan[i])
+            groupColumns.push_back(i);
+    AggrCollectorVisitor collector(aggrs);
+    for (auto& f : this->funcs)
+        f->accept(&collector);
+    visitor = make_unique<AccumulatorComputerVisitor>(source->getType(), aggrs);
+}
+HashAggregateDS::~HashAggregateDS() {}
+void HashAggregateDS::build() {
+    ValueArray key(groupColumns.size());
+    source->reset();
+    while (!source->hasEnded()) {
+        const ValueArray& row = *source->get().record;
+        for (int i = 0; i < groupColumns.size(); i++)
+            key[i] = row[groupColumns[i]];
+        auto it = groupIds.find(key);
+        if (it == groupIds.end()) {
+            it = groupIds.emplace(key, groups.size()).first;
+            groups.emplace_back();
+            groups.back().firstRow = row;
+            makeAccumulators(aggrs, groups.back().accumulators);
+        }
+        accumulateRow(source->getType(), row, aggrs, groups[it->second].accumulators);
+        source->advance();
+    }
+    hasBeenBuilt = true;
+}
+void HashAggregateDS::update() {
+    if (index >= groups.size()) return;
+    const Group& group = groups[index];
+    for (int i = 0; i < groupColumns.size(); i++)
+        (*recordData)[i] = group.firstRow[groupColumns[i]];
+    visitor->setGroup(&group.firstRow, &group.accumulators);
+    for (int i = 0; i < funcs.size(); i++) {
+        funcs[i]->accept(visitor.get());
+        (*recordData)[groupColumns.size() + i] = visitor->getResult();
+    }
+}
+void HashAggregateDS::reset() {
+    if (!hasBeenBuilt)
+        build();
+    index = 0;
+    update();
+}
+void HashAggregateDS::advance() {
+    index++;
+    update();
+}
+bool HashAggregateDS::hasEnded() const {
+    return index >= groups.size();
 }
\ No newline at end of file
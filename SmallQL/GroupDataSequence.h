@@ -1,6 +1,7 @@
 #pragma once
 
 #include "DataSequence.h"
+#include <unordered_map>
 
 struct GroupRecordPtr {
     IntermediateType type;
@@ -28,44 +29,84 @@ public:
     }
 };
 
-class GroupifierDS : public GroupDataSequence {
+class DegroupifierDS : public DataSequence {
 private:
-    DataSequence* source;
-    unique_ptr<vector<ValueArray>> data;
-    bool ended;
+    GroupDataSequence* source;
+    unique_ptr<ValueArray> data;
     void update();
 public:
-    GroupifierDS(const IntermediateType& type, vector<bool> isGrouped, DataSequence* source);
+    DegroupifierDS(const IntermediateType& type, GroupDataSequence* source);
     virtual void reset();
     virtual void advance();
     virtual bool hasEnded() const;
 };
 
-class DegroupifierDS : public DataSequence {
+class Accumulator;
+class AccumulatorComputerVisitor;
+struct AggrFuncQNode;
+// Groups a source sorted on the grouped columns and feeds each row straight into the accumulators,
+// a group comes out as its first row followed by the function results
+class AggregatorDS : public GroupDataSequence {
 private:
-    GroupDataSequence* source;
-    unique_ptr<ValueArray> data;
+    DataSequence* source;
+    vector<unique_ptr<QScalarNode>> funcs;
+    vector<AggrFuncQNode*> aggrs;
+    vector<unique_ptr<Accumulator>> accumulators;
+    // GroupRecordPtr exposes a group as its rows, an aggregated group is this single row
+    vector<ValueArray> group;
+    unique_ptr<AccumulatorComputerVisitor> visitor;
+    bool ended;
     void update();
 public:
-    DegroupifierDS(const IntermediateType& type, GroupDataSequence* source);
+    AggregatorDS(const IntermediateType& type, vector<bool> isGrouped,
+        DataSequence* source, 
+        vector<unique_ptr<QScalarNode>> funcs);
+    ~AggregatorDS();
     virtual void reset();
     virtual void advance();
     virtual bool hasEnded() const;
 };
 
-class GroupComputerVisitor;
-class AggregatorDS : public GroupDataSequence {
+struct GroupKeyHash {
+    size_t operator()(const ValueArray& key) const {
+        size_t h = 0;
+        for (const auto& v : key)
+            h = h * 0x9E3779B97F4A7C15ull + hashValue(v);
+        return h ^ (h >> 29);
+    }
+};
+struct GroupKeyEqual {
+    bool operator()(const ValueArray& a, const ValueArray& b) const {
+        for (size_t i = 0; i < a.size(); i++)
+            if (compareValue(a[i], b[i]) != 0) return false;
+        return true;
+    }
+};
+
+// Reads the whole source once, keeping the first row and one accumulator per aggregate for every group
+class HashAggregateDS : public DataSequence {
 private:
-    GroupDataSequence* source;
+    struct Group {
+        ValueArray firstRow;
+        vector<unique_ptr<Accumulator>> accumulators;
+    };
+    DataSequence* source;
+    vector<uint16_t> groupColumns;
     vector<unique_ptr<QScalarNode>> funcs;
-    unique_ptr<vector<ValueArray>> data;
-    unique_ptr<GroupComputerVisitor> visitor;
+    vector<AggrFuncQNode*> aggrs;
+    unordered_map<ValueArray, int, GroupKeyHash, GroupKeyEqual> groupIds;
+    vector<Group> groups;
+    unique_ptr<ValueArray> recordData;
+    unique_ptr<AccumulatorComputerVisitor> visitor;
+    int index;
+    bool hasBeenBuilt;
+    void build();
     void update();
 public:
-    AggregatorDS(const IntermediateType& type, vector<bool> isGrouped,
-        GroupDataSequence* source, 
-        vector<unique_ptr<QScalarNode>> funcs);
+    HashAggregateDS(const IntermediateType& type, DataSequence* source,
+        const vector<bool>& groupPlan, vector<unique_ptr<QScalarNode>> funcs);
+    ~HashAggregateDS();
     virtual void reset();
     virtual void advance();
     virtual bool hasEnded() const;
-};
\ No newline at end of file
+};
@@ -2,18 +2,27 @@
 #include "IndexFilePrivate.h"
 #include "DataType.h"
 #include <iostream>
+#include <algorithm>
+#include <queue>
+#include <cstdio>
 
 #define INDEXFILE_ID(tableId, indexId) ((tableId & 0xFFFF) << 16 | (indexId & 0xFFFF))
 
+// Header byte 0x04: 0x02 stores keys in the memcmp-comparable Schema::encodeKey form,
+// 0x03 is a B+tree with every entry in the linked leaves,
+// 0x04 stores packed keys in variable length cells with truncated separators
+const uint8_t INDEX_FORMAT_VERSION = 0x04;
+
 IndexFile::IndexFile(TransactionManager& trMan, int tableId, int indexId, const Schema& keySchema, bool isUnique)
     : Pager(trMan, INDEXFILE_ID(tableId, indexId))
     , keySchema(keySchema)
     , isUnique(isUnique) {
     Page headerPage = retrieveWrite(0);
     if (memcmp(headerPage, "SmDI", 4) != 0) {
-        initFile(tableId, indexId, keySchema.getSize(), headerPage);
+        initFile(tableId, indexId, keySchema.getKeySize(), isUnique, headerPage);
     }
     initPointers(headerPage);
+    advise(AccessPattern::Random);
 }
 
 IndexFile::IndexFile(TransactionManager& trMan, const SystemInfoManager& sysMan, string tableName, string indexName)
@@ -26,6 +35,12 @@ void IndexFile::deleteFile(TransactionManager& trMan, int tableId, int indexId)
     trMan.deleteFile(INDEXFILE_ID(tableId, indexId));
 }
 
+bool IndexFile::isCurrent(TransactionManager& trMan, int tableId, int indexId) {
+    Pager pager(trMan, INDEXFILE_ID(tableId, indexId));
+    Page headerPage = pager.retrieveRead(0);
+    return memcmp(headerPage, "SmDI", 4) == 0 && headerPage[0x04] == INDEX_FORMAT_VERSION;
+}
+
 void IndexFile::initPointers(Page headerPage) {
     keySize = *(uint16_t*)(headerPage + 0x0A);
     totalPageCount = (uint32_t*)(headerPage + 0x10);
@@ -33,29 +48,23 @@ void IndexFile::initPointers(Page headerPage) {
     rootPageId = (NodeId*)(headerPage + 0x18);
     page0Data = headerPage + 0x20;
 
-    overflowMode = keySize <= 2030 ? 0 : keySize <= 4077 ? 1 : 2;
-    leafCellSize = keySize + 8;
-    internalCellSize = overflowMode ? 2029 : keySize + 12;
-
-    cellsPerLeafPage = (PAGE_SIZE - 0x06) / (leafCellSize + 2);
-    cellsPerInternalPage = overflowMode ? 4 : (PAGE_SIZE - 0x0A) / (internalCellSize + 2);
-
     if (*rootPageId == NULL32) {
-        LeafNode newRoot = LeafNode::create(*this, NULL32, keySize);
+        LeafNode newRoot = LeafNode::create(*this, NULL32);
         *rootPageId = newRoot.getId();
         (*totalPageCount)++;
         update(0);
     }
 }
 
-void IndexFile::initFile(int tableId, int indexId, uint16_t keySize, Page headerPage) {
+void IndexFile::initFile(int tableId, int indexId, uint16_t keySize, bool isUnique, Page headerPage) {
     memcpy(headerPage, "SmDI", 4);
-    headerPage[0x04] = 0x01;
+    headerPage[0x04] = INDEX_FORMAT_VERSION;
     const int ZERO_PAGE_KEY_LIMIT = 2022;
     headerPage[0x05] = keySize > ZERO_PAGE_KEY_LIMIT? 0x01 : 0x00;
     *(uint16_t*)(headerPage + 0x06) = tableId;
     *(uint16_t*)(headerPage + 0x08) = indexId;
     *(uint16_t*)(headerPage + 0x0A) = keySize;
+    headerPage[0x0C] = isUnique ? 0x01 : 0x00;
     *(uint32_t*)(headerPage + 0x10) = 1;
     *(NodeId*)(headerPage + 0x14) = NULL32;
     *(NodeId*)(headerPage + 0x18) = NULL32;
@@ -121,197 +130,300 @@ void IndexFile::updateParent(NodeId id, NodeId parent) {
     update(lastParentingPageId);
 }
 
-bool IndexFile::addKey(const char* key, RecordId val) {
+// Unique indexes route by the key alone, so an equal key is always in the same leaf
+NodeId IndexFile::findLeaf(const char* key, uint32_t length, RecordId val) const {
+    IndexFile& self = const_cast<IndexFile&>(*this);
     NodeId currentId = *rootPageId;
     while (true) {
         Page page = retrieveRead(currentId);
-        if (page[0] == 0x01) { // Internal
-            InternalNode n(*this, currentId, keySize);
-            n.consistencyCheck();
-            n.internalConsistencyCheck();
-            pair<bool, SlotId> p = isUnique? n.binarySearch(key) : n.binarySearch(key, val);
-            if (p.first) return false;
-            if (p.second == n.cellCount())
-                currentId = n.rightPtr();
-            else
-                currentId = n.getCellLeftPtr(p.second);
-        }
-        else { // Leaf
-            LeafNode n(*this, currentId, keySize);
-            n.consistencyCheck();
-            pair<bool, SlotId> p = isUnique? n.binarySearch(key) : n.binarySearch(key, val);
-            if (p.first) return false;
-            n.insertIntoNode(key, val);
-            return true;
-        }
+        if (page[0] != 0x01) // Leaf
+            return currentId;
+        InternalNode n(self, currentId, false);
+        currentId = n.child(n.route(key, length, val));
     }
 }
 
+bool IndexFile::addKey(const char* key, RecordId val) {
+    vector<char> packed(keySize);
+    uint32_t length = keySchema.packKey(key, packed.data());
+    LeafNode n(*this, findLeaf(packed.data(), length, val));
+    n.consistencyCheck();
+    pair<bool, SlotId> p = isUnique? n.binarySearch(packed.data(), length) : n.binarySearch(packed.data(), length, val);
+    if (p.first) return false;
+    if (isUnique)
+        p = n.binarySearch(packed.data(), length, val);
+    n.insertIntoNode(packed.data(), length, val, p.second);
+    return true;
+}
+
 RecordId IndexFile::findKey(const char* key) {
-    NodeId currentId = *rootPageId;
-    while (true) {
-        Page page = retrieveRead(currentId);
-        if (page[0] == 0x01) { // Internal
-            InternalNode n(*this, currentId, keySize);
-            pair<bool, SlotId> p = n.binarySearch(key);
-            if (p.first) return n.getCellRecord(p.second);
-            if (p.second == n.cellCount())
-                currentId = n.rightPtr();
-            else
-                currentId = n.getCellLeftPtr(p.second);
-        }
-        else { // Leaf
-            LeafNode n(*this, currentId, keySize);
-            pair<bool, SlotId> p = n.binarySearch(key);
-            if (p.first) return n.getCellRecord(p.second);
-            return NULL64;
-        }
-    }
+    const_iterator iter = lowerBound(KeyBound{ vector<char>(key, key + keySize), true });
+    if (iter == end() || memcmp(iter.getKey(), key, keySize) != 0)
+        return NULL64;
+    return *iter;
 }
 
 bool IndexFile::deleteKey(const char* key, RecordId val) {
-    NodeId currentId = *rootPageId;
-    Page page = retrieveRead(currentId);
-    if (page[0] == 0x01) { // Internal
-        InternalNode n(*this, currentId, keySize);
-        return n.deleteFromNode(key, val);
-    }
-    else { // Leaf
-        LeafNode n(*this, currentId, keySize);
-        return n.deleteFromNode(key, val);
-    }
+    vector<char> packed(keySize);
+    uint32_t length = keySchema.packKey(key, packed.data());
+    LeafNode n(*this, findLeaf(packed.data(), length, val));
+    return n.deleteFromNode(packed.data(), length, val);
 }
 
 void IndexFile::fullConsistencyCheck(NodeId id) {
 #ifdef CHECKS_ENABLED
     Page page = retrieveRead(id);
     if (page[0] == 0x01) { // Internal
-        InternalNode n(*this, id, keySize);
-        n.consistencyCheck();
+        InternalNode n(*this, id);
         n.internalConsistencyCheck();
-        for (int i = 0; i < n.cellCount(); i++)
-            fullConsistencyCheck(n.getCellLeftPtr(i));
-        fullConsistencyCheck(n.rightPtr());
+        for (int i = 0; i <= n.cellCount(); i++)
+            fullConsistencyCheck(n.child(i));
     }
     else { // Leaf
-        LeafNode n(*this, id, keySize);
+        LeafNode n(*this, id);
         n.consistencyCheck();
     }
 #endif
 }
 
-bool IndexFile::fillFrom(const DataFile& dataFile, const Schema& tableSchema) {
-    for (auto iter = dataFile.begin(); iter != dataFile.end(); iter++) {
-        auto decoded = tableSchema.decode(*iter, nullptr);
-        auto keys = keySchema.narrow(decoded);
-        auto keysEncoded = keySchema.encode(keys).first;
-        bool result = addKey(keysEncoded, iter.getRecordId());
-        if (!result)
+// In key order every insert descends the path the previous one left cached
+bool IndexFile::addKeys(vector<pair<vector<char>, RecordId>>& keys) {
+    sort(keys.begin(), keys.end(), [this](const pair<vector<char>, RecordId>& a, const pair<vector<char>, RecordId>& b) {
+        int cmp = memcmp(a.first.data(), b.first.data(), keySize);
+        return cmp != 0 ? cmp < 0 : a.second < b.second;
+    });
+    for (const auto& p : keys) {
+        if (!addKey(p.first, p.second))
             return false;
     }
     return true;
 }
 
-void IndexFile::CustomIterator::updateValue() {
-    if (ptrStack.size() == 0) return;
-    NodeId nodeId = ptrStack.back().first;
-    SlotId slotId = ptrStack.back().second;
-    Page p = indexFile->retrieveRead(nodeId);
-    if (p[0] == 0x01) { // Internal
-        InternalNode n(const_cast<IndexFile&>(*indexFile), nodeId, indexFile->keySize);
-        recordId = n.getCellRecord(slotId);
-    }
-    else { // Leaf
-        LeafNode n(const_cast<IndexFile&>(*indexFile), nodeId, indexFile->keySize);
-        recordId = n.getCellRecord(slotId);
+// Entries past this are sorted and spilled to a temporary file as one run
+const size_t SORT_RUN_BYTES = 64 << 20;
+
+static FILE* openTempFile() {
+    FILE* f;
+#ifdef _MSC_VER
+    if (tmpfile_s(&f) != 0) f = NULL;
+#else
+    f = tmpfile();
+#endif
+    if (!f) {
+        cout << "ERROR! Couldn't create a temporary file for sorting" << endl;
+        exit(1);
     }
+    return f;
 }
 
-void IndexFile::CustomIterator::advance() {
-    while (true) {
-        if (ptrStack.size() == 0) return;
-        NodeId& nodeId = ptrStack.back().first;
-        SlotId& slotId = ptrStack.back().second;
-        Page p = indexFile->retrieveRead(nodeId);
-        if (p[0] == 0x01) { // Internal
-            InternalNode n(const_cast<IndexFile&>(*indexFile), nodeId, indexFile->keySize);
-            if (slotId == n.cellCount()) {
-                ptrStack.pop_back();
-                continue;
-            }
+// External merge sort of fixed size entries
+template<typename Less>
+class EntrySorter {
+    size_t entrySize;
+    Less less;
+    vector<char> buffer;
+    vector<const char*> order;
+    vector<FILE*> runs;
+    uint64_t count;
 
-            slotId++;
-            if (slotId == n.cellCount()) {
-                ptrStack.push_back(make_pair(n.rightPtr(), 0));
-                continue;
+    void sortBuffer() {
+        order.clear();
+        for (size_t i = 0; i < buffer.size(); i += entrySize)
+            order.push_back(&buffer[i]);
+        sort(order.begin(), order.end(), less);
+    }
+    void spill() {
+        sortBuffer();
+        FILE* f = openTempFile();
+        for (const char* entry : order)
+            fwrite(entry, entrySize, 1, f);
+        rewind(f);
+        runs.push_back(f);
+        buffer.clear();
+    }
+public:
+    EntrySorter(size_t entrySize, Less less) : entrySize(entrySize), less(less), count(0) {}
+    ~EntrySorter() {
+        for (FILE* f : runs)
+            fclose(f);
+    }
+
+    void add(const char* entry) {
+        buffer.insert(buffer.end(), entry, entry + entrySize);
+        count++;
+        if (buffer.size() >= SORT_RUN_BYTES)
+            spill();
+    }
+    inline uint64_t size() const {
+        return count;
+    }
+
+    // Calls f on every entry in order, stops as soon as it returns false
+    template<typename F>
+    bool forEach(F f) {
+        sortBuffer();
+        size_t memoryRun = runs.size();
+        vector<vector<char>> heads(runs.size(), vector<char>(entrySize));
+        auto greater = [this](const pair<const char*, size_t>& a, const pair<const char*, size_t>& b) {
+            return less(b.first, a.first);
+        };
+        priority_queue<pair<const char*, size_t>, vector<pair<const char*, size_t>>, decltype(greater)> queue(greater);
+        for (size_t i = 0; i < runs.size(); i++) {
+            if (fread(heads[i].data(), entrySize, 1, runs[i]) == 1)
+                queue.emplace(heads[i].data(), i);
+        }
+        size_t memoryPos = 0;
+        if (!order.empty())
+            queue.emplace(order[0], memoryRun);
+
+        while (!queue.empty()) {
+            pair<const char*, size_t> top = queue.top();
+            queue.pop();
+            if (!f(top.first))
+                return false;
+            if (top.second == memoryRun) {
+                if (++memoryPos < order.size())
+                    queue.emplace(order[memoryPos], memoryRun);
             }
-            else {
-                ptrStack.push_back(make_pair(n.getCellLeftPtr(slotId), 0));
-                continue;
+            else if (fread(heads[top.second].data(), entrySize, 1, runs[top.second]) == 1)
+                queue.emplace(heads[top.second].data(), top.second);
+        }
+        return true;
+    }
+};
+
+bool IndexFile::fillFrom(const DataFile& dataFile, const Schema& tableSchema, double fillFactor) {
+    // Entries are the record id followed by the key
+    uint32_t entrySize = keySize + 8;
+    auto less = [this](const char* a, const char* b) {
+        int r = memcmp(a + 8, b + 8, keySize);
+        if (r != 0) return r < 0;
+        return *(const RecordId*)a < *(const RecordId*)b;
+    };
+    EntrySorter<decltype(less)> sorter(entrySize, less);
+    vector<char> entry(entrySize);
+    for (auto iter = dataFile.begin(); iter != dataFile.end(); iter++) {
+        auto decoded = tableSchema.decode(*iter, nullptr);
+        auto keys = keySchema.narrow(decoded);
+        RecordId recordId = iter.getRecordId();
+        memcpy(entry.data(), &recordId, 8);
+        keySchema.encodeKey(keys, entry.data() + 8);
+        sorter.add(entry.data());
+    }
+    if (sorter.size() == 0)
+        return true;
+
+    fillFactor = max(0.5, min(1.0, fillFactor));
+    uint32_t budget = (uint32_t)(PAGE_SIZE * fillFactor);
+
+    // The empty root page is reused by the first leaf
+    deallocatePage(*rootPageId);
+
+    vector<NodeId> children;
+    vector<Separator> separators;
+    vector<LeafEntry> entries;
+    uint32_t cellBytes = 0;
+    auto flushLeaf = [&]() {
+        LeafNode leaf = LeafNode::create(*this, NULL32);
+        leaf.rebuild(entries, 0, entries.size());
+        if (!children.empty()) {
+            LeafNode(*this, children.back()).nextLeaf() = leaf.getId();
+            update(children.back());
+        }
+        children.push_back(leaf.getId());
+    };
+    LeafEntry current;
+    bool result = sorter.forEach([&](const char* e) {
+        current.record = *(const RecordId*)e;
+        current.key.resize(keySize);
+        current.key.resize(keySchema.packKey(e + 8, current.key.data()));
+        if (isUnique && !entries.empty() && entries.back().key == current.key)
+            return false;
+
+        // The leaf is full once its cells and their shared prefix would go past the budget
+        if (!entries.empty()) {
+            uint32_t common = LeafNode::commonPrefix(entries[0], current);
+            uint32_t size = 0x0C + common + cellBytes + 12 + (uint32_t)current.key.size() - (uint32_t)(entries.size() + 1) * common;
+            if (size > budget) {
+                flushLeaf();
+                separators.push_back(Separator::between(entries.back(), current));
+                entries.clear();
+                cellBytes = 0;
             }
         }
-        else { // Leaf
-            LeafNode n(const_cast<IndexFile&>(*indexFile), nodeId, indexFile->keySize);
-            
-            slotId++;
-            if (slotId == n.cellCount()) {
-                ptrStack.pop_back();
-                continue;
+        entries.push_back(current);
+        cellBytes += 12 + (uint32_t)current.key.size();
+        return true;
+    });
+    if (!result)
+        return false;
+    flushLeaf();
+
+    while (children.size() > 1) {
+        vector<NodeId> parents;
+        vector<Separator> upperSeparators;
+        size_t next = 0;
+        while (next < children.size()) {
+            InternalNode n = InternalNode::create(*this, NULL32);
+            uint32_t size = 0x0C;
+            while (next + 1 < children.size() &&
+                (n.cellCount() == 0 || size + InternalNode::cellSize(separators[next]) + 2 <= budget)) {
+                size += InternalNode::cellSize(separators[next]) + 2;
+                n.appendSeparator(separators[next], children[next]);
+                updateParent(children[next], n.getId());
+                next++;
             }
-            break;
+            n.rightPtr() = children[next];
+            updateParent(children[next], n.getId());
+            update(n.getId());
+            parents.push_back(n.getId());
+            // The separator after the last child of the node goes up
+            if (next + 1 < children.size())
+                upperSeparators.push_back(separators[next]);
+            next++;
         }
+        children.swap(parents);
+        separators.swap(upperSeparators);
     }
-    updateValue();
+    setNewRoot(children[0]);
+    return true;
 }
 
-IndexFile::const_iterator IndexFile::getIterator(const char* key) {
-    vector<pair<NodeId, SlotId>> ptrStack;
-    NodeId currentId = *rootPageId;
-    while (true) {
-        Page page = retrieveRead(currentId);
-        if (page[0] == 0x01) { // Internal
-            InternalNode n(*this, currentId, keySize);
-            pair<bool, SlotId> p = n.binarySearch(key);
-            ptrStack.emplace_back(currentId, p.second);
-            if (p.first)
-                return const_iterator(n.getCellRecord(p.second), ptrStack, this);
-            if (p.second == n.cellCount()) {
-                currentId = n.rightPtr();
-            } 
-            else
-                currentId = n.getCellLeftPtr(p.second);
-        }
-        else { // Leaf
-            LeafNode n(*this, currentId, keySize);
-            pair<bool, SlotId> p = n.binarySearch(key);
-            ptrStack.emplace_back(currentId, p.second);
-            return const_iterator(n.getCellRecord(p.second), ptrStack, this);
+// Skips past the end of emptied leaves, the end iterator has no leaf
+void IndexFile::CustomIterator::updateValue() {
+    IndexFile& index = const_cast<IndexFile&>(*indexFile);
+    while (leafId != NULL32) {
+        LeafNode n(index, leafId, false);
+        if (slotId < n.cellCount()) {
+            recordId = n.getCellRecord(slotId);
+            packedKey.clear();
+            n.readKey(slotId, packedKey);
+            key.resize(indexFile->keySize);
+            indexFile->keySchema.unpackKey(packedKey.data(), key.data());
+            return;
         }
+        leafId = n.nextLeaf();
+        slotId = 0;
     }
+    recordId = NULL64;
 }
 
-IndexFile::const_iterator IndexFile::getIterator(ValueArray key) {
-    vector<pair<NodeId, SlotId>> ptrStack;
+IndexFile::const_iterator IndexFile::begin() const {
+    IndexFile& self = const_cast<IndexFile&>(*this);
     NodeId currentId = *rootPageId;
-    while (true) {
-        Page page = retrieveRead(currentId);
-        if (page[0] == 0x01) { // Internal
-            InternalNode n(*this, currentId, keySize);
-            pair<bool, SlotId> p = n.binarySearch(key);
-            ptrStack.emplace_back(currentId, p.second);
-            if (p.first)
-                return const_iterator(n.getCellRecord(p.second), ptrStack, this);
-            if (p.second == n.cellCount()) {
-                currentId = n.rightPtr();
-            } 
-            else
-                currentId = n.getCellLeftPtr(p.second);
-        }
-        else { // Leaf
-            LeafNode n(*this, currentId, keySize);
-            pair<bool, SlotId> p = n.binarySearch(key);
-            ptrStack.emplace_back(currentId, p.second);
-            return const_iterator(n.getCellRecord(p.second), ptrStack, this);
-        }
+    while (retrieveRead(currentId)[0] == 0x01) // Internal
+        currentId = InternalNode(self, currentId, false).child(0);
+    return const_iterator(currentId, 0, this);
+}
+
+IndexFile::const_iterator IndexFile::lowerBound(const KeyBound& from) {
+    vector<char> bound(keySize);
+    uint32_t length = keySchema.packKey(from.prefix.data(), bound.data(), (uint32_t)from.prefix.size());
+    NodeId currentId = *rootPageId;
+    while (retrieveRead(currentId)[0] == 0x01) { // Internal
+        InternalNode n(*this, currentId, false);
+        currentId = n.child(n.lowerBound(bound.data(), length, from.inclusive));
     }
-}
\ No newline at end of file
+    LeafNode n(*this, currentId, false);
+    return const_iterator(currentId, n.lowerBound(bound.data(), length, from.inclusive), this);
+}
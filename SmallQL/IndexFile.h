@@ -11,6 +11,8 @@ using namespace std;
 
 const int PARENTING_ZERO_SIZE = 2040;
 const int PARENTING_NORMAL_SIZE = 2048;
+// Share of a node filled by bulk loading, the rest is left for later inserts
+const double DEFAULT_FILL_FACTOR = 0.9;
 
 class IndexFile : public Pager {
     uint16_t keySize;
@@ -18,25 +20,23 @@ class IndexFile : public Pager {
     NodeId* fplStart;
     NodeId* rootPageId;
     char* page0Data;
-    
-    uint16_t leafCellSize;
-    uint16_t internalCellSize;
-    int overflowMode;
 
     const Schema& keySchema;
 
-    void initFile(int tableId, int indexId, uint16_t keySize, Page headerPage);
+    void initFile(int tableId, int indexId, uint16_t keySize, bool isUnique, Page headerPage);
     void initPointers(Page headerPage);
+    // Search keys are packed, see Schema::packKey
+    NodeId findLeaf(const char* key, uint32_t length, RecordId val) const;
 
     NodeId lastParentingPageId;
 public:
-    uint16_t cellsPerLeafPage;
-    uint16_t cellsPerInternalPage;
     bool isUnique;
 
     IndexFile(TransactionManager& trMan, int tableId, int indexId, const Schema& keySchema, bool isUnique);
     IndexFile(TransactionManager& trMan, const SystemInfoManager& sysMan, string tableName, string indexName = "primary");
     static void deleteFile(TransactionManager& trMan, int tableId, int indexId);
+    // Whether the file exists and stores keys in the current format
+    static bool isCurrent(TransactionManager& trMan, int tableId, int indexId);
 
     NodeId allocateFreePage();
     void deallocatePage(NodeId id);
@@ -51,6 +51,8 @@ public:
     inline bool addKey(const vector<char>& key, RecordId val) {
         return addKey(key.data(), val);
     }
+    // Sorts the batch and adds it in key order, stops at the first duplicate
+    bool addKeys(vector<pair<vector<char>, RecordId>>& keys);
     RecordId findKey(const char* key);
     inline RecordId findKey(const vector<char>& key) {
         return findKey(key.data());
@@ -60,9 +62,10 @@ public:
         return deleteKey(key.data(), val);
     }
 
-    bool fillFrom(const DataFile& dataFile, const Schema& tableSchema);
+    // Builds the index bottom-up from the sorted keys of the table, the index must be empty
+    bool fillFrom(const DataFile& dataFile, const Schema& tableSchema, double fillFactor = DEFAULT_FILL_FACTOR);
 
-    inline uint32_t getKeySize() {
+    inline uint32_t getKeySize() const {
         return keySize;
     }
     inline const Schema& getKeySchema() {
@@ -73,6 +76,22 @@ public:
         update(0);
     }
 
+    // Leading part of a key where a range scan starts or stops
+    struct KeyBound {
+        vector<char> prefix;
+        bool inclusive;
+    };
+    inline KeyBound makeBound(const ValueArray& values, bool inclusive, bool isLower) const {
+        KeyBound bound{ vector<char>(keySchema.getKeySize()), inclusive };
+        bound.prefix.resize(keySchema.encodeKeyBound(values, isLower, bound.inclusive, bound.prefix.data()));
+        return bound;
+    }
+    static inline bool isWithinUpper(const char* key, const KeyBound& to) {
+        if (to.prefix.empty()) return true;
+        int r = memcmp(key, to.prefix.data(), to.prefix.size());
+        return r < 0 || (r == 0 && to.inclusive);
+    }
+
     class CustomIterator {
     public:
         using iterator_category = std::forward_iterator_tag;
@@ -82,28 +101,31 @@ public:
         using reference = const value_type&;
     private:
         RecordId recordId;
-        vector<pair<NodeId, SlotId>> ptrStack;
+        vector<char> key;
+        vector<char> packedKey;
+        NodeId leafId;
+        SlotId slotId;
         const IndexFile* indexFile;
         void updateValue();
-        void advance();
     public:
-        CustomIterator(RecordId recordId, vector<pair<NodeId, SlotId>> ptrStack, const IndexFile* indexFile)
-            : recordId(recordId)
-            , ptrStack(ptrStack)
-            , indexFile(indexFile){}
-        CustomIterator(vector<pair<NodeId, SlotId>> ptrStack, const IndexFile* indexFile)
+        CustomIterator(NodeId leafId, SlotId slotId, const IndexFile* indexFile)
             : recordId(NULL64)
-            , ptrStack(ptrStack)
-            , indexFile(indexFile){
+            , leafId(leafId)
+            , slotId(slotId)
+            , indexFile(indexFile) {
             updateValue();
         }
 
         reference operator*() const { return recordId; }
         pointer operator->() { return &recordId; }
+        inline const char* getKey() const {
+            return key.data();
+        }
 
         // Prefix increment
         inline CustomIterator& operator++() {
-            advance();
+            slotId++;
+            updateValue();
             return *this;
         }
 
@@ -115,20 +137,18 @@ public:
         }
 
         friend inline bool operator== (const CustomIterator& a, const CustomIterator& b) { 
-            return a.ptrStack == b.ptrStack; 
+            return a.leafId == b.leafId && a.slotId == b.slotId; 
         };
         friend inline bool operator!= (const CustomIterator& a, const CustomIterator& b) { 
-            return a.ptrStack != b.ptrStack; 
+            return !(a == b); 
         };
     };
     using const_iterator = CustomIterator;
 
-    const_iterator begin() const {
-        return const_iterator(vector<pair<NodeId, SlotId>>{make_pair(*rootPageId, 0)}, this);
-    }
+    const_iterator begin() const;
     const_iterator end() const {
-        return const_iterator(NULL64, vector<pair<NodeId, SlotId>>{}, this);
+        return const_iterator(NULL32, 0, this);
     }
-    const_iterator getIterator(const char* key);
-    const_iterator getIterator(ValueArray key);
+    // First key past the lower bound
+    const_iterator lowerBound(const KeyBound& from);
 };
\ No newline at end of file
@@ -1,967 +1,525 @@
 #pragma once
 #include "Common.h"
 #include "IndexFile.h"
-#include <set>
 #include <iostream>
 
+// Lexicographic order of the bytes of a followed by the bytes of b against c, a proper prefix goes first
+static inline int compareBytes(const char* a, uint32_t aLength, const char* b, uint32_t bLength,
+    const char* c, uint32_t cLength) {
+    uint32_t length = min(aLength, cLength);
+    int r = memcmp(a, c, length);
+    if (r != 0 || aLength > cLength) return r != 0 ? r : 1;
+    if (bLength > 0) {
+        length = min(bLength, cLength - aLength);
+        r = memcmp(b, c + aLength, length);
+        if (r != 0) return r;
+    }
+    return cmp(aLength + bLength, cLength);
+}
+static inline int compareBytes(const char* a, uint32_t aLength, const char* b, uint32_t bLength) {
+    return compareBytes(a, aLength, NULL, 0, b, bLength);
+}
+
+// Entries are handled as packed keys, see Schema::packKey
+struct LeafEntry {
+    RecordId record;
+    vector<char> key;
+};
+
+// Only the leading bytes of the first key of the right node that tell it apart from
+// the last key of the left one, the record id is only needed when the two keys are equal
+struct Separator {
+    vector<char> key;
+    bool hasRecord;
+    RecordId record;
+
+    static Separator between(const LeafEntry& left, const LeafEntry& right) {
+        if (left.key == right.key)
+            return Separator{ right.key, true, right.record };
+        size_t length = 0;
+        while (length < left.key.size() && left.key[length] == right.key[length])
+            length++;
+        return Separator{ vector<char>(right.key.begin(), right.key.begin() + length + 1), false, 0 };
+    }
+};
+
+// Slotted page: the header up to 0x0C, the key prefix shared by the page, the cell offsets,
+// then the free space and the cells packed at the end of the page
 class TreeNode {
 protected:
     NodeId id;
+    PageHandle handle;
     Page page;
-    uint16_t cellSize;
-    uint16_t cellPtrOffset;
-    uint16_t cellHeader;
-    uint16_t fclStartOffset;
     IndexFile& index;
 public:
-    uint16_t maxCellCount;
-    uint16_t minCellCount;
-    TreeNode(IndexFile& index, uint16_t keySize, uint16_t cellPtrOffset, 
-        uint16_t cellHeader, uint16_t fclStartOffset)
-    : TreeNode(index, index.allocateFreePage(), keySize, 
-        cellPtrOffset, cellHeader, 
-        fclStartOffset) {}
-    TreeNode(IndexFile& index, NodeId id, uint16_t keySize, uint16_t cellPtrOffset, 
-        uint16_t cellHeader, uint16_t fclStartOffset)
-        : index(index)
-        , id(id)
-        , page(index.retrieveWrite(id))
-        , cellSize(keySize + cellHeader)
-        , cellHeader(cellHeader)
-        , cellPtrOffset(cellPtrOffset)
-        , fclStartOffset(fclStartOffset)
-        , maxCellCount(0)
-        , minCellCount(0) {}
+    // Read-only nodes look at the cached page instead of a transaction copy, pinned while the node lives
+    TreeNode(IndexFile& index, NodeId id, bool forWrite)
+        : id(id)
+        , handle(forWrite ? PageHandle() : index.readHandle(id))
+        , page(forWrite ? index.retrieveWrite(id) : handle.get())
+        , index(index) {}
     inline uint16_t& cellCount() {
         return *(uint16_t*)(page + 0x02);
     }
+    inline uint16_t& cellStart() {
+        return *(uint16_t*)(page + 0x04);
+    }
+    inline uint16_t& prefixLength() {
+        return *(uint16_t*)(page + 0x06);
+    }
+    inline char* prefix() {
+        return page + 0x0C;
+    }
+    inline uint16_t& cellOffset(SlotId slot) {
+        return ((uint16_t*)(page + 0x0C + prefixLength()))[slot];
+    }
+    inline char* getCell(SlotId slot) {
+        return page + cellOffset(slot);
+    }
     inline NodeId getId() {
         return id;
     }
     inline NodeId& parent() {
         return index.nodeParent(id);
     }
-    inline char* getCellRaw(CellId id) {
-        return page + PAGE_SIZE - (id + 1) * cellSize;
+    // Free bytes between the cell offsets and the cells, holes left by deleted cells don't count
+    inline uint32_t freeSpace() {
+        return cellStart() - (0x0C + prefixLength() + 2 * cellCount());
     }
-    inline CellId& cellId(SlotId id) {
-        return ((CellId*)(page + cellPtrOffset))[id];
+
+    void clear(const char* newPrefix, uint16_t length) {
+        cellCount() = 0;
+        cellStart() = PAGE_SIZE;
+        prefixLength() = length;
+        memcpy(prefix(), newPrefix, length);
+        index.update(id);
     }
-    inline char* getCell(SlotId id) {
-        return getCellRaw(cellId(id));
+    // Puts a cell at the given slot, the node must have room for it
+    void insertCell(SlotId slot, const char* data, uint16_t size) {
+        assert(freeSpace() >= size + 2u);
+        uint16_t* place = &cellOffset(slot);
+        if (slot != cellCount())
+            memmove(place + 1, place, (cellCount() - slot) * 2);
+        cellStart() -= size;
+        *place = cellStart();
+        memcpy(page + cellStart(), data, size);
+        cellCount()++;
+        index.update(id);
     }
-    inline char* getCellData(SlotId id) {
-        return getCell(id) + cellHeader;
+    inline void appendCell(const char* data, uint16_t size) {
+        insertCell(cellCount(), data, size);
     }
-    inline RecordId& getCellRecord(SlotId id) {
-        return *(RecordId*)getCell(id);
+    // The cell space is reclaimed the next time the page is rebuilt
+    void removeCell(SlotId slot) {
+        if (slot != cellCount() - 1)
+            memmove(&cellOffset(slot), &cellOffset(slot) + 1, (cellCount() - slot - 1) * 2);
+        cellCount()--;
+        index.update(id);
     }
-    inline char* getCellDataRaw(CellId id) {
-        return getCellRaw(id) + cellHeader;
+};
+
+// Separators only route searches: a child holds the entries below its separator,
+// the entries from the last separator on are under rightPtr.
+// A cell is the left child, the key length with 0x8000 set if a record id follows the key,
+// the key and the record id
+class InternalNode : public TreeNode {
+public:
+    static InternalNode create(IndexFile& index, NodeId parent) {
+        InternalNode result(index, index.allocateFreePage());
+        Page p = result.page;
+        p[0] = 0x01;
+        p[1] = 0x00;
+        index.updateParent(result.id, parent);
+        *(uint32_t*)(p + 0x08) = NULL32;
+        result.clear(NULL, 0);
+        return result;
     }
-    inline RecordId& getCellRecordRaw(CellId id) {
-        return *(RecordId*)getCellRaw(id);
+    InternalNode(IndexFile& index, NodeId id, bool forWrite = true)
+        : TreeNode(index, id, forWrite) {}
+
+    static inline uint16_t cellSize(const Separator& separator) {
+        return (uint16_t)(6 + separator.key.size() + (separator.hasRecord ? 8 : 0));
     }
-    inline CellId& fclStart() {
-        return *(CellId*)(page + fclStartOffset);
+
+    inline NodeId& rightPtr() {
+        return *(NodeId*)(page + 0x08);
     }
-#ifdef CHECKS_ENABLED
-    inline void consistencyCheck() {
-        for (int i = 0; i < cellCount() - 1; i++) {
-            assert(*(uint32_t*)getCellData(i) <= *(uint32_t*)getCellData(i + 1));
-        }
+    inline NodeId& getCellLeftPtr(SlotId slot) {
+        return *(NodeId*)getCell(slot);
     }
-#else
-    inline void consistencyCheck() {}
-#endif // CHECKS_ENABLED
-
-    
-
-    CellId allocateCell() {
-        assert(cellCount() < maxCellCount);
-        if (fclStart() != NULL16) {
-            CellId result = fclStart();
-            fclStart() = *(CellId*)getCellRaw(result);
-            index.update(id);
-            return result;
-        }
-        return cellCount();
+    inline NodeId& child(SlotId slot) {
+        return slot == cellCount() ? rightPtr() : getCellLeftPtr(slot);
     }
-    inline void deallocateCell(CellId cell) {
-        *(CellId*)getCellRaw(cell) = fclStart();
-        fclStart() = cell;
-        index.update(id);
+    inline uint16_t separatorLength(SlotId slot) {
+        return *(uint16_t*)(getCell(slot) + 4) & 0x7FFF;
     }
-    
-    inline int compareKey(const char* key, SlotId slotId) {
-        char* otherKey = getCellData(slotId);
-        return index.getKeySchema().compare(key, otherKey);
+    inline bool hasRecord(SlotId slot) {
+        return (*(uint16_t*)(getCell(slot) + 4) & 0x8000) != 0;
     }
-    inline int compareKey(const char* key, SlotId slotId, RecordId record) {
-        int r = compareKey(key, slotId);
-        if (r != 0) return r;
-        return cmp(record, getCellRecord(slotId));
+    inline char* separatorKey(SlotId slot) {
+        return getCell(slot) + 6;
     }
-
-    inline int compareKey(ValueArray key, SlotId slotId) {
-        char* otherKey = getCellData(slotId);
-        return index.getKeySchema().compare(key, otherKey);
+    inline RecordId separatorRecord(SlotId slot) {
+        return *(RecordId*)(separatorKey(slot) + separatorLength(slot));
     }
-    inline int compareKey(ValueArray key, SlotId slotId, RecordId record) {
-        int r = compareKey(key, slotId);
-        if (r != 0) return r;
-        return cmp(record, getCellRecord(slotId));
+    Separator getSeparator(SlotId slot) {
+        char* key = separatorKey(slot);
+        return Separator{ vector<char>(key, key + separatorLength(slot)),
+            hasRecord(slot), hasRecord(slot) ? separatorRecord(slot) : 0 };
     }
 
-    pair<bool, SlotId> binarySearch(const char* key) {
-        if (cellCount() == 0) return make_pair(false, 0);
-        SlotId l = 0;
-        SlotId r = cellCount();
-        while (l < r) {
-            SlotId mid = l + (r - l) / 2;
-            int result = compareKey(key, mid);
-            if (result == 0)
-                return make_pair(true, mid);
-            if (result < 0)
-                r = mid;
-            else
-                l = mid + 1;
-        }
-        return make_pair(false, r);
+    // A key equal to a truncated separator is at or past it
+    inline int compareSeparator(const char* key, uint32_t length, RecordId record, SlotId slot) {
+        int r = compareBytes(key, length, separatorKey(slot), separatorLength(slot));
+        if (r != 0 || !hasRecord(slot)) return r;
+        return cmp(record, separatorRecord(slot));
     }
 
-    pair<bool, SlotId> binarySearch(const char* key, RecordId record) {
-        if (cellCount() == 0) return make_pair(false, 0);
+    // Slot of the child an entry belongs to
+    SlotId route(const char* key, uint32_t length, RecordId record) {
         SlotId l = 0;
         SlotId r = cellCount();
         while (l < r) {
             SlotId mid = l + (r - l) / 2;
-            int result = compareKey(key, mid, record);
-            if (result == 0)
-                return make_pair(true, mid);
-            if (result < 0)
+            if (compareSeparator(key, length, record, mid) < 0)
                 r = mid;
             else
                 l = mid + 1;
         }
-        return make_pair(false, r);
+        return l;
     }
 
-    pair<bool, SlotId> binarySearch(ValueArray key) {
-        if (cellCount() == 0) return make_pair(false, 0);
+    // Slot of the first child that can hold a key past the bound given by a packed key prefix
+    SlotId lowerBound(const char* bound, uint32_t length, bool inclusive) {
         SlotId l = 0;
         SlotId r = cellCount();
         while (l < r) {
             SlotId mid = l + (r - l) / 2;
-            int result = compareKey(key, mid);
-            if (result == 0)
-                return make_pair(true, mid);
-            if (result < 0)
+            uint32_t separatorLength = min<uint32_t>(this->separatorLength(mid), length);
+            int result = compareBytes(separatorKey(mid), separatorLength, bound, length);
+            if (result > 0 || (result == 0 && inclusive))
                 r = mid;
             else
                 l = mid + 1;
         }
-        return make_pair(false, r);
+        return l;
+    }
+
+    static vector<char> makeCell(const Separator& separator, NodeId childId) {
+        vector<char> cell(cellSize(separator));
+        memcpy(cell.data(), &childId, 4);
+        *(uint16_t*)(cell.data() + 4) = (uint16_t)separator.key.size() | (separator.hasRecord ? 0x8000 : 0);
+        memcpy(cell.data() + 6, separator.key.data(), separator.key.size());
+        if (separator.hasRecord)
+            memcpy(cell.data() + 6 + separator.key.size(), &separator.record, 8);
+        return cell;
+    }
+    inline void appendSeparator(const Separator& separator, NodeId childId) {
+        vector<char> cell = makeCell(separator, childId);
+        appendCell(cell.data(), (uint16_t)cell.size());
+    }
+
+    static void growRoot(IndexFile& index, NodeId left, const Separator& separator, NodeId right) {
+        InternalNode newRoot = InternalNode::create(index, NULL32);
+        newRoot.appendSeparator(separator, left);
+        newRoot.rightPtr() = right;
+        index.update(newRoot.id);
+        index.updateParent(left, newRoot.id);
+        index.updateParent(right, newRoot.id);
+        index.setNewRoot(newRoot.id);
+    }
+
+    // Rewrites the node with separators[from, to) and the children around them
+    void rebuild(const vector<Separator>& separators, const vector<NodeId>& children, size_t from, size_t to) {
+        clear(NULL, 0);
+        for (size_t i = from; i < to; i++) {
+            appendSeparator(separators[i], children[i]);
+            index.updateParent(children[i], id);
+        }
+        rightPtr() = children[to];
+        index.updateParent(children[to], id);
+        index.update(id);
     }
 
-    pair<bool, SlotId> binarySearch(ValueArray key, RecordId record) {
-        if (cellCount() == 0) return make_pair(false, 0);
-        SlotId l = 0;
-        SlotId r = cellCount();
-        while (l < r) {
-            SlotId mid = l + (r - l) / 2;
-            int result = compareKey(key, mid, record);
-            if (result == 0)
-                return make_pair(true, mid);
-            if (result < 0)
-                r = mid;
-            else
-                l = mid + 1;
+    // Adds the separator of a child that was split, the new right half goes after it
+    void insertSeparator(const Separator& separator, NodeId leftChild, NodeId rightChild) {
+        SlotId slot = 0;
+        while (child(slot) != leftChild) {
+            assert(slot < cellCount());
+            slot++;
+        }
+        uint16_t size = cellSize(separator);
+        if (freeSpace() >= size + 2u) {
+            vector<char> cell = makeCell(separator, leftChild);
+            insertCell(slot, cell.data(), size);
+            child(slot + 1) = rightChild;
+            index.updateParent(rightChild, id);
+            index.update(id);
+            internalConsistencyCheck();
+            return;
         }
-        return make_pair(false, r);
-    }
 
-    inline void fillNextSlotData(const char* data) {
-        CellId id = allocateCell();
-        cellId(cellCount()) = id;
-        memcpy(getCellRaw(id), data, cellSize);
-        cellCount()++;
-        index.update(this->id);
-    }
+        vector<Separator> separators;
+        vector<NodeId> children;
+        uint32_t total = 0x0C;
+        for (SlotId i = 0; i < cellCount(); i++) {
+            separators.push_back(getSeparator(i));
+            children.push_back(getCellLeftPtr(i));
+            total += cellSize(separators.back()) + 2;
+        }
+        children.push_back(rightPtr());
+        separators.insert(separators.begin() + slot, separator);
+        children.insert(children.begin() + slot + 1, rightChild);
+        total += size + 2;
+
+        // Holes from removed cells may be all that is missing
+        if (total <= PAGE_SIZE) {
+            rebuild(separators, children, 0, separators.size());
+            return;
+        }
 
-    struct SiblingResult {
-        NodeId left, right;
-        char* keyLeft, *keyRight;
-        RecordId recordLeft, recordRight;
-    };
+        // Split in the middle by bytes, the separator there moves up instead of being kept on either side
+        size_t median = 0;
+        uint32_t leftSize = 0x0C;
+        while (median + 1 < separators.size() && leftSize + cellSize(separators[median]) + 2 <= total / 2) {
+            leftSize += cellSize(separators[median]) + 2;
+            median++;
+        }
+        InternalNode right = InternalNode::create(index, parent());
+        rebuild(separators, children, 0, median);
+        right.rebuild(separators, children, median + 1, separators.size());
+        Separator upSeparator = separators[median];
+        NodeId parentId = parent();
+        if (parentId == NULL32)
+            growRoot(index, id, upSeparator, right.id);
+        else
+            InternalNode(index, parentId).insertSeparator(upSeparator, id, right.id);
+    }
 
-    inline SiblingResult getSiblings();
+#ifdef CHECKS_ENABLED
+    inline void internalConsistencyCheck() {
+        for (int i = 0; i <= cellCount(); i++) {
+            assert(index.nodeParent(child(i)) == this->id);
+        }
+    }
+#else
+    inline void internalConsistencyCheck() {}
+#endif // CHECKS_ENABLED
 };
 
-class InternalNode : public TreeNode {
-protected:
-    uint16_t keySize;
+// The page prefix is the common prefix of every key in the leaf, a cell is the record id,
+// the length of the rest of the key and the rest of the key
+class LeafNode : public TreeNode {
 public:
-    static InternalNode create(IndexFile& index, NodeId parent, uint16_t keySize) {
-        InternalNode result(index, index.allocateFreePage(), keySize);
+    static LeafNode create(IndexFile& index, NodeId parent) {
+        LeafNode result(index, index.allocateFreePage());
         Page p = result.page;
-        p[0] = 0x01;
+        p[0] = 0x03;
         p[1] = 0x00;
-        *(uint16_t*)(p + 0x02) = 0;
         index.updateParent(result.id, parent);
-        *(uint32_t*)(p + 0x04) = NULL32;
-        *(uint16_t*)(p + 0x08) = NULL16;
-        index.update(result.id);
+        *(NodeId*)(p + 0x08) = NULL32;
+        result.clear(NULL, 0);
         return result;
     }
-    InternalNode(IndexFile& index, NodeId id, uint16_t keySize)
-        : TreeNode(index, id, keySize, 0x0A, 12, 0x08)
-        , keySize(keySize) {
-        maxCellCount = index.cellsPerInternalPage;
-        minCellCount = maxCellCount / 2;
-    }
+    LeafNode(IndexFile& index, NodeId id, bool forWrite = true)
+        : TreeNode(index, id, forWrite) {}
 
-    inline NodeId& rightPtr() {
-        return *(NodeId*)(page + 0x04);
+    inline NodeId& nextLeaf() {
+        return *(NodeId*)(page + 0x08);
     }
-    inline NodeId& getCellLeftPtr(SlotId id) {
-        return *(NodeId*)(getCell(id) + 8);
+    inline RecordId& getCellRecord(SlotId slot) {
+        return *(RecordId*)getCell(slot);
     }
-    inline NodeId& getCellLeftPtrRaw(CellId id) {
-        return *(NodeId*)(getCellRaw(id) + 8);
+    inline uint16_t suffixLength(SlotId slot) {
+        return *(uint16_t*)(getCell(slot) + 8);
     }
-
-    inline void fillNextSlot(const char* key, RecordId record, NodeId childId) {
-        CellId id = allocateCell();
-        cellId(cellCount()) = id;
-        memcpy(getCellRaw(id), &record, 8);
-        memcpy(getCellRaw(id) + 8, &childId, 4);
-        memcpy(getCellRaw(id) + cellHeader, key, keySize);
-        cellCount()++;
-        index.update(this->id);
-    }
-
-    struct SplitResult {
-        NodeId left, right;
-        char* key;
-        RecordId record;
-    };
-
-    SplitResult splitNode(char* key, RecordId record, NodeId childId, SlotId position) {
-        SlotId median = cellCount() / 2;
-        InternalNode left = InternalNode::create(index, parent(), keySize);
-        InternalNode right = InternalNode::create(index, parent(), keySize);
-        for (int i = 0; i < median; i++) {
-            if (i == position) {
-                left.fillNextSlot(key, record, childId);
-                index.updateParent(childId, left.id);
-            }
-            left.fillNextSlotData(getCell(i));
-            index.updateParent(getCellLeftPtr(i), left.id);
-        }
-        left.rightPtr() = getCellLeftPtr(median);
-        index.updateParent(left.rightPtr(), left.id);
-
-        if (median == position) {
-            left.fillNextSlot(key, record, childId);
-            index.updateParent(childId, left.id);
-        }
-        for (int i = median + 1; i < cellCount(); i++) {
-            if (i == position) {
-                right.fillNextSlot(key, record, childId);
-                index.updateParent(childId, right.id);
-            }
-            right.fillNextSlotData(getCell(i));
-            index.updateParent(getCellLeftPtr(i), right.id);
-        }
-        if (position == cellCount()) {
-            right.fillNextSlot(key, record, childId);
-            index.updateParent(childId, right.id);
-        }
-        right.rightPtr() = rightPtr();
-        index.updateParent(right.rightPtr(), right.id);
-
-        SplitResult result;
-        result.left = left.id;
-        result.right = right.id;
-        
-        memcpy(key, getCellData(median), keySize);
-        result.key = key;
-        result.record = getCellRecord(median);
-        
-        index.deallocatePage(id);
-        index.update(id);
-        index.update(left.id);
-        index.update(right.id);
-        left.consistencyCheck();
-        right.consistencyCheck();
-        return result;
+    inline char* suffix(SlotId slot) {
+        return getCell(slot) + 10;
     }
-
-    void updateChild(const char* key, RecordId record, NodeId newChild) {
-        pair<bool, SlotId> p = binarySearch(key, record);
-        if (p.second == cellCount())
-            rightPtr() = newChild;
-        else
-            getCellLeftPtr(p.second) = newChild;
-        index.update(id);
-        index.updateParent(newChild, id);
-
-        internalConsistencyCheck();
-        consistencyCheck();
+    // Packed key of the cell appended to out
+    inline void readKey(SlotId slot, vector<char>& out) {
+        out.insert(out.end(), prefix(), prefix() + prefixLength());
+        out.insert(out.end(), suffix(slot), suffix(slot) + suffixLength(slot));
     }
 
-    void updateEntry(const char* key, RecordId record, const char* newKey, RecordId newRecord) {
-        internalConsistencyCheck();
-        consistencyCheck();
-
-        pair<bool, SlotId> p = binarySearch(key, record);
-        CellId cell = cellId(p.second);
-        memcpy(getCellDataRaw(cell), newKey, keySize);
-        getCellRecordRaw(cell) = newRecord;
-        index.update(id);
-        
-        internalConsistencyCheck();
-        consistencyCheck();
+    inline int compareKey(const char* key, uint32_t length, SlotId slot) {
+        return -compareBytes(prefix(), prefixLength(), suffix(slot), suffixLength(slot), key, length);
+    }
+    inline int compareKey(const char* key, uint32_t length, SlotId slot, RecordId record) {
+        int r = compareKey(key, length, slot);
+        if (r != 0) return r;
+        return cmp(record, getCellRecord(slot));
     }
 
 #ifdef CHECKS_ENABLED
-    inline void internalConsistencyCheck() {
+    inline void consistencyCheck() {
+        vector<char> previous, current;
         for (int i = 0; i < cellCount(); i++) {
-            assert(index.nodeParent(getCellLeftPtr(i)) == this->id);
+            current.clear();
+            readKey(i, current);
+            if (i > 0)
+                assert(compareKey(previous.data(), previous.size(), i, getCellRecord(i - 1)) < 0);
+            previous.swap(current);
         }
-        assert(index.nodeParent(rightPtr()) == this->id);
     }
 #else
-    inline void internalConsistencyCheck() {}
+    inline void consistencyCheck() {}
 #endif // CHECKS_ENABLED
 
-    
-
-    void insertIntoChild(char* key, RecordId record);
-    void insertIntoChild(char* key, RecordId record, NodeId newChild) {
-        pair<bool, SlotId> p = binarySearch(key, record);
-        NodeId currentId = rightPtr();
-        if (p.second != cellCount())
-            currentId = getCellLeftPtr(p.second);
-        InternalNode n(index, currentId, keySize);
-        n.insertIntoNode(key, record, newChild);
-        consistencyCheck();
-        internalConsistencyCheck();
-        n.consistencyCheck();
-        n.internalConsistencyCheck();
-    }
-
-    void insertIntoNode(char* key, RecordId record, NodeId newChild) {
-        internalConsistencyCheck();
-        consistencyCheck();
-        pair<bool, SlotId> p = binarySearch(key, record);
-        if (p.first) return;
-        if (cellCount() == maxCellCount) 
-            if (tryRebalance(p.second)) {
-                internalConsistencyCheck();
-                consistencyCheck();
-                InternalNode parentNode(index, parent(), keySize);
-                parentNode.consistencyCheck();
-                parentNode.internalConsistencyCheck();
-                parentNode.insertIntoChild(key, record, newChild);
-                return;
-            }
-        if (cellCount() < maxCellCount) {
-            CellId* insertionPlace = &cellId(p.second);
-            if (p.second != cellCount())
-                memmove(insertionPlace + 1, insertionPlace, (cellCount() - p.second) * 2);
-            CellId cell = allocateCell();
-            *insertionPlace = cell;
-            getCellRecordRaw(cell) = record;
-            getCellLeftPtrRaw(cell) = newChild;
-            memcpy(getCellDataRaw(cell), key, keySize);
-            cellCount()++;
-            index.update(id);
-            index.updateParent(newChild, id);
-            internalConsistencyCheck();
-            consistencyCheck();
-            return;
-        }
-
-        NodeId parentId = parent();
-        SplitResult split = splitNode(key, record, newChild, p.second);
-        if (parentId == NULL32) {
-            InternalNode newRoot = InternalNode::create(index, NULL32, keySize);
-            newRoot.fillNextSlot(split.key, split.record, split.left);
-            newRoot.rightPtr() = split.right;
-            index.setNewRoot(newRoot.getId());
-            index.update(newRoot.getId());
-            index.updateParent(split.left, newRoot.getId());
-            index.updateParent(split.right, newRoot.getId());
-            internalConsistencyCheck();
-            consistencyCheck();
-            newRoot.internalConsistencyCheck();
-            newRoot.consistencyCheck();
-            return;
-        }
-
-        InternalNode parentNode(index, parentId, keySize);
-        
-        parentNode.updateChild(split.key, split.record, split.right);
-        parentNode.insertIntoNode(split.key, split.record, split.left);
-    }
-
-    void rebalanceLeft(InternalNode& leftNode, InternalNode& parentNode) {
-        uint16_t leftCount = leftNode.cellCount();
-        uint16_t thisCount = this->cellCount();
-        uint16_t totalCount = leftCount + thisCount + 1;
-        uint16_t newMedianPosition = totalCount / 2;
-        uint16_t targetLeftCount = newMedianPosition;
-        uint16_t targetThisCount = totalCount - 1 - targetLeftCount;
-        uint16_t cellsToMove = targetLeftCount - leftCount - 1;
-        uint16_t newMedianPositionInThisNode = newMedianPosition - leftCount - 1;
-
-        // find the current median
-        CellId zeroCell = this->cellId(0);
-        char* leastKey = this->getCellDataRaw(zeroCell);
-        RecordId leastRecord = this->getCellRecordRaw(zeroCell);
-        pair<bool, SlotId> p = parentNode.binarySearch(leastKey, leastRecord); // the left pointer of this should be this node
-        SlotId oldMedianSlot = p.second - 1;
-        CellId oldMedianCell = parentNode.cellId(oldMedianSlot);
-        char* oldMedianKey = parentNode.getCellDataRaw(oldMedianCell);
-        RecordId& oldMedianRecord = parentNode.getCellRecordRaw(oldMedianCell);
-
-        // copy the current median to the end of left node
-        leftNode.fillNextSlot(oldMedianKey, oldMedianRecord, leftNode.rightPtr());
-        // copy all the needed entries from this node
-        for (int i = 0; i < cellsToMove; i++) {
-            CellId sourceCell = this->cellId(i);
-            leftNode.fillNextSlotData(this->getCellRaw(sourceCell));
-            index.updateParent(this->getCellLeftPtrRaw(sourceCell), leftNode.id);
-            this->cellCount()--;
-            this->deallocateCell(sourceCell);
-        }
-        // copy new median
-        CellId newMedianCell = this->cellId(newMedianPositionInThisNode);
-        leftNode.rightPtr() = this->getCellLeftPtrRaw(newMedianCell);
-        index.updateParent(leftNode.rightPtr(), leftNode.id);
-        memcpy(oldMedianKey, this->getCellDataRaw(newMedianCell), keySize);
-        oldMedianRecord = this->getCellRecordRaw(newMedianCell);
-        
-        this->cellCount()--;
-        this->deallocateCell(newMedianCell);
-        // move the rest of the keys in this node
-        memmove(&this->cellId(0), &this->cellId(cellsToMove + 1), sizeof(CellId) * targetThisCount);
-        consistencyCheck();
-        internalConsistencyCheck();
-        leftNode.consistencyCheck();
-        leftNode.internalConsistencyCheck();
-        parentNode.consistencyCheck();
-        parentNode.internalConsistencyCheck();
-    }
-
-    void rebalanceRight(InternalNode& rightNode, InternalNode& parentNode) {
-        uint16_t rightCount = rightNode.cellCount();
-        uint16_t thisCount = this->cellCount();
-        uint16_t totalCount = rightCount + thisCount + 1;
-        uint16_t newMedianPosition = (totalCount - 1) / 2;
-        uint16_t targetThisCount = newMedianPosition;
-        uint16_t targetRightCount = totalCount - 1 - targetThisCount;
-        uint16_t cellsToMove = targetRightCount - rightCount - 1;
-
-        // find the current median
-        CellId zeroCell = this->cellId(0);
-        char* leastKey = this->getCellDataRaw(zeroCell);
-        RecordId leastRecord = this->getCellRecordRaw(zeroCell);
-        pair<bool, SlotId> p = parentNode.binarySearch(leastKey, leastRecord); // the left pointer of this should be this node
-        SlotId oldMedianSlot = p.second;
-        CellId oldMedianCell = parentNode.cellId(oldMedianSlot);
-        char* oldMedianKey = parentNode.getCellDataRaw(oldMedianCell);
-        RecordId& oldMedianRecord = parentNode.getCellRecordRaw(oldMedianCell);
-
-        // free space for the slots in the right node
-        memmove(&rightNode.cellId(cellsToMove + 1), &rightNode.cellId(0), sizeof(CellId) * rightCount);
-        
-        // copy the old median to the right node
-        CellId oldMedianNewCell = rightNode.allocateCell();
-        rightNode.cellId(cellsToMove) = oldMedianNewCell;
-        rightNode.getCellRecordRaw(oldMedianNewCell) = oldMedianRecord;
-        memcpy(rightNode.getCellDataRaw(oldMedianNewCell), oldMedianKey, keySize);
-        rightNode.getCellLeftPtrRaw(oldMedianNewCell) = this->rightPtr();
-        index.updateParent(rightNode.getCellLeftPtrRaw(oldMedianNewCell), rightNode.id);
-        rightNode.cellCount()++;
-
-        // copy the other part of the cells from this node to the right
-        for (int i = cellsToMove - 1; i >= 0; i--) {
-            CellId newCellId = rightNode.allocateCell();
-            rightNode.cellId(i) = newCellId;
-            CellId sourceCell = this->cellId(thisCount - cellsToMove + i);
-            memcpy(rightNode.getCellRaw(newCellId), this->getCellRaw(sourceCell), cellSize);
-            index.updateParent(rightNode.getCellLeftPtrRaw(newCellId), rightNode.id);
-            rightNode.cellCount()++;
-            this->cellCount()--;
-            this->deallocateCell(sourceCell);
-        }
-
-        // copy the new median into place
-        CellId newMedianCell = this->cellId(newMedianPosition);
-        this->rightPtr() = this->getCellLeftPtrRaw(newMedianCell);
-        memcpy(oldMedianKey, this->getCellDataRaw(newMedianCell), keySize);
-        oldMedianRecord = this->getCellRecordRaw(newMedianCell);
-        this->cellCount()--;
-        this->deallocateCell(newMedianCell);
-        consistencyCheck();
-        internalConsistencyCheck();
-        rightNode.consistencyCheck();
-        rightNode.internalConsistencyCheck();
-        parentNode.consistencyCheck();
-        parentNode.internalConsistencyCheck();
-    }
-
-    bool tryRebalance(SlotId insertionPlace) {
-        SiblingResult siblings = getSiblings();
-        if (siblings.left != NULL32) {
-            InternalNode leftNode(index, siblings.left, keySize);
-            if (leftNode.cellCount() >= leftNode.maxCellCount - 1) return false;
-            InternalNode parentNode(index, parent(), keySize);
-            consistencyCheck();
-            internalConsistencyCheck();
-            leftNode.consistencyCheck();
-            leftNode.internalConsistencyCheck();
-            parentNode.consistencyCheck();
-            parentNode.internalConsistencyCheck();
-
-            rebalanceLeft(leftNode, parentNode);
-            index.update(this->id);
-            index.update(this->parent());
-            index.update(leftNode.id);
-            
-            consistencyCheck();
-            internalConsistencyCheck();
-            leftNode.consistencyCheck();
-            leftNode.internalConsistencyCheck();
-            parentNode.consistencyCheck();
-            parentNode.internalConsistencyCheck();
-            return true;
-        }
-        if (siblings.right != NULL32) {
-            InternalNode rightNode(index, siblings.right, keySize);
-            if (rightNode.cellCount() >= rightNode.maxCellCount - 1) return false;
-            InternalNode parentNode(index, parent(), keySize);
-            consistencyCheck();
-            internalConsistencyCheck();
-            rightNode.consistencyCheck();
-            rightNode.internalConsistencyCheck();
-            parentNode.consistencyCheck();
-            parentNode.internalConsistencyCheck();
-
-            rebalanceRight(rightNode, parentNode);
-            index.update(this->id);
-            index.update(this->parent());
-            index.update(rightNode.id);
-
-            consistencyCheck();
-            internalConsistencyCheck();
-            rightNode.consistencyCheck();
-            rightNode.internalConsistencyCheck();
-            parentNode.consistencyCheck();
-            parentNode.internalConsistencyCheck();
-            return true;
+    pair<bool, SlotId> binarySearch(const char* key, uint32_t length) {
+        SlotId l = 0;
+        SlotId r = cellCount();
+        while (l < r) {
+            SlotId mid = l + (r - l) / 2;
+            int result = compareKey(key, length, mid);
+            if (result == 0)
+                return make_pair(true, mid);
+            if (result < 0)
+                r = mid;
+            else
+                l = mid + 1;
         }
-        return false;
+        return make_pair(false, r);
     }
 
-    NodeId findRightmostNode() {
-        NodeId currentId = rightPtr();
-        while (true) {
-            Page page = index.retrieveRead(currentId);
-            if (page[0] == 0x01) { // Internal
-                InternalNode n(index, currentId, keySize);
-                currentId = n.rightPtr();
-            }
+    pair<bool, SlotId> binarySearch(const char* key, uint32_t length, RecordId record) {
+        SlotId l = 0;
+        SlotId r = cellCount();
+        while (l < r) {
+            SlotId mid = l + (r - l) / 2;
+            int result = compareKey(key, length, mid, record);
+            if (result == 0)
+                return make_pair(true, mid);
+            if (result < 0)
+                r = mid;
             else
-                return currentId;
+                l = mid + 1;
         }
+        return make_pair(false, r);
     }
 
-    bool deleteFromNode(const char* key, RecordId record);
-};
-
-class LeafNode : public TreeNode {
-protected:
-    uint16_t keySize;
-public:
-    static LeafNode create(IndexFile& index, NodeId parent, uint16_t keySize) {
-        LeafNode result(index, index.allocateFreePage(), keySize);
-        Page p = result.page;
-        p[0] = 0x03;
-        p[1] = 0x00;
-        *(uint16_t*)(p + 0x02) = 0;
-        index.updateParent(result.id, parent);
-        *(uint16_t*)(p + 0x04) = NULL16;
-        index.update(result.id);
-        return result;
-    }
-    LeafNode(IndexFile& index, NodeId id, uint16_t keySize)
-        : TreeNode(index, id, keySize, 0x06, 8, 0x04)
-        , keySize(keySize) {
-        maxCellCount = index.cellsPerLeafPage;
-        minCellCount = maxCellCount / 2;
-    }
-
-    inline void fillNextSlot(const char* key, RecordId record) {
-        CellId id = allocateCell();
-        cellId(cellCount()) = id;
-        memcpy(getCellRaw(id), &record, 8);
-        memcpy(getCellRaw(id) + cellHeader, key, keySize);
-        cellCount()++;
-        index.update(this->id);
-    }
-
-    struct SplitResult {
-        NodeId left, right;
-        char* key;
-        RecordId record;
-    };
-
-    SplitResult splitNode(char* key, RecordId record, SlotId position) {
-        SlotId median = cellCount() / 2;
-        LeafNode left = LeafNode::create(index, parent(), keySize);
-        LeafNode right = LeafNode::create(index, parent(), keySize);
-        for (int i = 0; i < median; i++) {
-            if (i == position) left.fillNextSlot(key, record);
-            left.fillNextSlotData(getCell(i));
+    // First slot whose key is past the bound given by a packed key prefix
+    SlotId lowerBound(const char* bound, uint32_t length, bool inclusive) {
+        SlotId l = 0;
+        SlotId r = cellCount();
+        while (l < r) {
+            SlotId mid = l + (r - l) / 2;
+            uint32_t prefixPart = min<uint32_t>(prefixLength(), length);
+            uint32_t suffixPart = min<uint32_t>(suffixLength(mid), length - prefixPart);
+            int result = compareBytes(prefix(), prefixPart, suffix(mid), suffixPart, bound, length);
+            if (result > 0 || (result == 0 && inclusive))
+                r = mid;
+            else
+                l = mid + 1;
         }
-        if (median == position) left.fillNextSlot(key, record);
-        for (int i = median + 1; i < cellCount(); i++) {
-            if (i == position) right.fillNextSlot(key, record);
-            right.fillNextSlotData(getCell(i));
+        return l;
+    }
+
+    static uint32_t commonPrefix(const LeafEntry& a, const LeafEntry& b) {
+        uint32_t length = 0;
+        while (length < a.key.size() && length < b.key.size() && a.key[length] == b.key[length])
+            length++;
+        return length;
+    }
+    // Page bytes taken by entries[from, to) with their common prefix stored once
+    static uint32_t pageSize(const vector<LeafEntry>& entries, size_t from, size_t to) {
+        if (from == to) return 0x0C;
+        uint32_t common = commonPrefix(entries[from], entries[to - 1]);
+        uint32_t total = 0x0C + common;
+        for (size_t i = from; i < to; i++)
+            total += 12 + (uint32_t)entries[i].key.size() - common;
+        return total;
+    }
+
+    vector<LeafEntry> takeEntries() {
+        vector<LeafEntry> entries(cellCount());
+        for (SlotId i = 0; i < cellCount(); i++) {
+            entries[i].record = getCellRecord(i);
+            readKey(i, entries[i].key);
+        }
+        return entries;
+    }
+    // Rewrites the node with entries[from, to), sorted and known to fit
+    void rebuild(const vector<LeafEntry>& entries, size_t from, size_t to) {
+        uint32_t common = from == to ? 0 : commonPrefix(entries[from], entries[to - 1]);
+        clear(from == to ? NULL : entries[from].key.data(), (uint16_t)common);
+        vector<char> cell;
+        for (size_t i = from; i < to; i++) {
+            uint16_t length = (uint16_t)(entries[i].key.size() - common);
+            cell.resize(10 + length);
+            memcpy(cell.data(), &entries[i].record, 8);
+            memcpy(cell.data() + 8, &length, 2);
+            memcpy(cell.data() + 10, entries[i].key.data() + common, length);
+            appendCell(cell.data(), (uint16_t)cell.size());
         }
-        if (position == cellCount())
-            right.fillNextSlot(key, record);
-
-        SplitResult result;
-        result.left = left.id;
-        result.right = right.id;
-
-        memcpy(key, getCellData(median), keySize);
-        result.key = key;
-        result.record = getCellRecord(median);
-
-        index.deallocatePage(id);
-        index.update(id);
-        index.update(left.id);
-        index.update(right.id);
-        left.consistencyCheck();
-        right.consistencyCheck();
-        return result;
     }
-    void insertIntoNode(const char* key, RecordId record) {
-        pair<bool, SlotId> p = binarySearch(key, record);
-        if (p.first) return;
-        if (cellCount() == maxCellCount) 
-            if (tryRebalance(p.second)) {
-                consistencyCheck();
-                InternalNode parentNode(index, parent(), keySize);
-                parentNode.consistencyCheck();
-                parentNode.internalConsistencyCheck();
-                char* keyCopy = new char[keySize];
-                memcpy(keyCopy, key, keySize);
-                parentNode.insertIntoChild(keyCopy, record);
-                delete[] keyCopy;
-                return;
-            }
-        if (cellCount() < maxCellCount) {
-            CellId* insertionPlace = &cellId(p.second);
-            if (p.second != cellCount())
-                memmove(insertionPlace + 1, insertionPlace, (cellCount() - p.second) * 2);
-            CellId cell = allocateCell();
-            *insertionPlace = cell;
-            *(RecordId*)getCellRaw(cell) = record;
-            memcpy(getCellRaw(cell) + 8, key, keySize);
-            cellCount()++;
-            index.update(id);
+
+    void insertIntoNode(const char* key, uint32_t length, RecordId record, SlotId slot) {
+        uint16_t common = prefixLength();
+        if (length >= common && memcmp(key, prefix(), common) == 0 && freeSpace() >= 12 + length - common) {
+            vector<char> cell(10 + length - common);
+            uint16_t suffixLength = (uint16_t)(length - common);
+            memcpy(cell.data(), &record, 8);
+            memcpy(cell.data() + 8, &suffixLength, 2);
+            memcpy(cell.data() + 10, key + common, suffixLength);
+            insertCell(slot, cell.data(), (uint16_t)cell.size());
             consistencyCheck();
             return;
         }
 
-        char* keyCopy = new char[keySize];
-        memcpy(keyCopy, key, keySize);
-
-        NodeId parentId = parent();
-        SplitResult split = splitNode(keyCopy, record, p.second);
-        if (parentId == NULL32) {
-            InternalNode newRoot = InternalNode::create(index, NULL32, keySize);
-            LeafNode leftNode(index, split.left, keySize);
-            LeafNode rightNode(index, split.right, keySize);
-            newRoot.fillNextSlot(split.key, split.record, split.left);
-            newRoot.rightPtr() = split.right;
-            index.updateParent(split.left, newRoot.getId());
-            index.updateParent(split.right, newRoot.getId());
-            index.setNewRoot(newRoot.getId());
-            index.update(newRoot.getId());
+        // The key breaks the page prefix or there is no room left next to the cells
+        bool isAppend = slot == cellCount() && nextLeaf() == NULL32;
+        vector<LeafEntry> entries = takeEntries();
+        entries.insert(entries.begin() + slot, LeafEntry{ record, vector<char>(key, key + length) });
+        size_t total = entries.size();
+        if (pageSize(entries, 0, total) <= PAGE_SIZE) {
+            rebuild(entries, 0, total);
             consistencyCheck();
-            newRoot.consistencyCheck();
-            newRoot.internalConsistencyCheck();
-            leftNode.consistencyCheck();
-            rightNode.consistencyCheck();
-            delete[] keyCopy;
             return;
         }
 
-        InternalNode parentNode(index, parentId, keySize);
-        
-        parentNode.updateChild(split.key, split.record, split.right);
-        parentNode.insertIntoNode(split.key, split.record, split.left);
-        delete[] keyCopy;
-    }
-
-    void rebalanceLeft(LeafNode& leftNode, InternalNode& parentNode) {
-        uint16_t leftCount = leftNode.cellCount();
-        uint16_t thisCount = this->cellCount();
-        uint16_t totalCount = leftCount + thisCount + 1;
-        uint16_t newMedianPosition = totalCount / 2;
-        uint16_t targetLeftCount = newMedianPosition;
-        uint16_t targetThisCount = totalCount - 1 - targetLeftCount;
-        uint16_t cellsToMove = targetLeftCount - leftCount - 1;
-        uint16_t newMedianPositionInThisNode = newMedianPosition - leftCount - 1;
-
-        // find the current median
-        CellId zeroCell = this->cellId(0);
-        char* leastKey = this->getCellDataRaw(zeroCell);
-        RecordId leastRecord = this->getCellRecordRaw(zeroCell);
-        pair<bool, SlotId> p = parentNode.binarySearch(leastKey, leastRecord); // the left pointer of this should be this node
-        SlotId oldMedianSlot = p.second - 1;
-        CellId oldMedianCell = parentNode.cellId(oldMedianSlot);
-        char* oldMedianKey = parentNode.getCellDataRaw(oldMedianCell);
-        RecordId& oldMedianRecord = parentNode.getCellRecordRaw(oldMedianCell);
-
-        // copy the current median to the end of left node
-        leftNode.fillNextSlot(oldMedianKey, oldMedianRecord);
-        // copy all the needed entries from this node
-        for (int i = 0; i < cellsToMove; i++) {
-            CellId sourceCell = this->cellId(i);
-            leftNode.fillNextSlotData(this->getCellRaw(sourceCell));
-            this->cellCount()--;
-            this->deallocateCell(sourceCell);
-        }
-        // copy new median
-        CellId newMedianCell = this->cellId(newMedianPositionInThisNode);
-        memcpy(oldMedianKey, this->getCellDataRaw(newMedianCell), keySize);
-        oldMedianRecord = this->getCellRecordRaw(newMedianCell);
-        this->cellCount()--;
-        this->deallocateCell(newMedianCell);
-        // move the rest of the keys in this node
-        memmove(&this->cellId(0), &this->cellId(cellsToMove + 1), sizeof(CellId) * targetThisCount);
-        parentNode.consistencyCheck();
-        parentNode.internalConsistencyCheck();
-    }
-
-    void rebalanceRight(LeafNode& rightNode, InternalNode& parentNode) {
-        uint16_t rightCount = rightNode.cellCount();
-        uint16_t thisCount = this->cellCount();
-        uint16_t totalCount = rightCount + thisCount + 1;
-        uint16_t newMedianPosition = (totalCount - 1) / 2;
-        uint16_t targetThisCount = newMedianPosition;
-        uint16_t targetRightCount = totalCount - 1 - targetThisCount;
-        uint16_t cellsToMove = targetRightCount - rightCount - 1;
-
-        // find the current median
-        CellId zeroCell = this->cellId(0);
-        char* leastKey = this->getCellDataRaw(zeroCell);
-        RecordId leastRecord = this->getCellRecordRaw(zeroCell);
-        pair<bool, SlotId> p = parentNode.binarySearch(leastKey, leastRecord); // the left pointer of this should be this node
-        SlotId oldMedianSlot = p.second;
-        CellId oldMedianCell = parentNode.cellId(oldMedianSlot);
-        char* oldMedianKey = parentNode.getCellDataRaw(oldMedianCell);
-        RecordId& oldMedianRecord = parentNode.getCellRecordRaw(oldMedianCell);
-
-        // free space for the slots in the right node
-        memmove(&rightNode.cellId(cellsToMove + 1), &rightNode.cellId(0), sizeof(CellId) * rightCount);
-        
-        // copy the old median to the right node
-        CellId oldMedianNewCell = rightNode.allocateCell();
-        rightNode.cellId(cellsToMove) = oldMedianNewCell;
-        rightNode.getCellRecordRaw(oldMedianNewCell) = oldMedianRecord;
-        memcpy(rightNode.getCellDataRaw(oldMedianNewCell), oldMedianKey, keySize);
-        rightNode.cellCount()++;
-
-        // copy the other part of the cells from this node to the right
-        for (int i = cellsToMove - 1; i >= 0; i--) {
-            CellId newCellId = rightNode.allocateCell();
-            rightNode.cellId(i) = newCellId;
-            CellId sourceCell = this->cellId(thisCount - cellsToMove + i);
-            memcpy(rightNode.getCellRaw(newCellId), this->getCellRaw(sourceCell), cellSize);
-            rightNode.cellCount()++;
-            this->cellCount()--;
-            this->deallocateCell(sourceCell);
+        // Appends to the last leaf leave it full, everywhere else the bytes are split in half.
+        // A key that breaks the prefix is at either end, so some split point always fits
+        size_t split = total - 1;
+        if (!isAppend) {
+            vector<uint32_t> cellBytes(total + 1, 0);
+            for (size_t i = 0; i < total; i++)
+                cellBytes[i + 1] = cellBytes[i] + 12 + (uint32_t)entries[i].key.size();
+            uint32_t best = NULL32;
+            for (size_t i = 1; i < total; i++) {
+                uint32_t leftCommon = commonPrefix(entries[0], entries[i - 1]);
+                uint32_t rightCommon = commonPrefix(entries[i], entries[total - 1]);
+                uint32_t leftSize = 0x0C + cellBytes[i] - (uint32_t)(i - 1) * leftCommon;
+                uint32_t rightSize = 0x0C + cellBytes[total] - cellBytes[i] - (uint32_t)(total - i - 1) * rightCommon;
+                if (leftSize > PAGE_SIZE || rightSize > PAGE_SIZE) continue;
+                if (max(leftSize, rightSize) < best) {
+                    best = max(leftSize, rightSize);
+                    split = i;
+                }
+            }
         }
+        LeafNode right = LeafNode::create(index, parent());
+        right.nextLeaf() = nextLeaf();
+        nextLeaf() = right.id;
+        rebuild(entries, 0, split);
+        right.rebuild(entries, split, total);
+        consistencyCheck();
+        right.consistencyCheck();
 
-        // copy the new median into place
-        CellId newMedianCell = this->cellId(newMedianPosition);
-        memcpy(oldMedianKey, this->getCellDataRaw(newMedianCell), keySize);
-        oldMedianRecord = this->getCellRecordRaw(newMedianCell);
-        this->cellCount()--;
-        this->deallocateCell(newMedianCell);
-        parentNode.consistencyCheck();
-        parentNode.internalConsistencyCheck();
-    }
-
-    bool tryRebalance(SlotId insertionPlace) {
-        SiblingResult siblings = getSiblings();
-        if (siblings.left != NULL32) {
-            LeafNode leftNode(index, siblings.left, keySize);
-            if (leftNode.cellCount() >= leftNode.maxCellCount - 1) return false;
-            InternalNode parentNode(index, parent(), keySize);
-            consistencyCheck();
-            leftNode.consistencyCheck();
-            parentNode.consistencyCheck();
-            parentNode.internalConsistencyCheck();
-
-            rebalanceLeft(leftNode, parentNode);
-            index.update(this->id);
-            index.update(this->parent());
-            index.update(leftNode.id);
-            return true;
-        }
-        if (siblings.right != NULL32) {
-            LeafNode rightNode(index, siblings.right, keySize);
-            if (rightNode.cellCount() >= rightNode.maxCellCount - 1) return false;
-            InternalNode parentNode(index, parent(), keySize);
-            consistencyCheck();
-            rightNode.consistencyCheck();
-            parentNode.consistencyCheck();
-            parentNode.internalConsistencyCheck();
-
-            rebalanceRight(rightNode, parentNode);
-            index.update(this->id);
-            index.update(this->parent());
-            index.update(rightNode.id);
-            return true;
-        }
-        return false;
+        Separator separator = Separator::between(entries[split - 1], entries[split]);
+        NodeId parentId = parent();
+        if (parentId == NULL32)
+            InternalNode::growRoot(index, id, separator, right.id);
+        else
+            InternalNode(index, parentId).insertSeparator(separator, id, right.id);
     }
 
-    bool deleteFromNode(const char* key, RecordId record) {
-        pair<bool, SlotId> p = binarySearch(key, record);
+    // Emptied leaves stay in the chain, separators above them remain valid bounds
+    bool deleteFromNode(const char* key, uint32_t length, RecordId record) {
+        pair<bool, SlotId> p = binarySearch(key, length, record);
         if (!p.first) return false;
-
-        CellId deletionPlace = cellId(p.second);
-        if (p.second != cellCount() - 1)
-            memmove(&cellId(p.second), &cellId(p.second) + 1, (cellCount() - p.second - 1) * 2);
-        deallocateCell(deletionPlace);
-        cellCount()--;
-        index.update(id);
+        removeCell(p.second);
         consistencyCheck();
         return true;
     }
 };
-
-inline TreeNode::SiblingResult TreeNode::getSiblings() {
-    SiblingResult result;
-    result.left = NULL32;
-    result.right = NULL32;
-    result.keyLeft = NULL;
-    result.keyRight = NULL;
-    result.recordLeft = NULL64;
-    result.recordRight = NULL64;
-    if (parent() == NULL32) return result;
-    InternalNode parentNode(index, parent(), cellSize - cellHeader);
-    SlotId rightSlot = cellCount() - 1;
-    char* key = getCellData(rightSlot);
-    RecordId record = getCellRecord(rightSlot);
-    pair<bool, SlotId> p = parentNode.binarySearch(key, record);
-    if (p.second == 0) {
-        result.right = parentNode.cellCount() == 1? parentNode.rightPtr() : parentNode.getCellLeftPtr(1);
-        CellId cell = parentNode.cellId(0);
-        result.keyRight = parentNode.getCellDataRaw(cell);
-        result.recordRight = parentNode.getCellRecordRaw(cell);
-    } 
-    else if (p.second == parentNode.cellCount()) {
-        CellId cell = parentNode.cellId(parentNode.cellCount() - 1);
-        result.left = parentNode.getCellLeftPtrRaw(cell);
-        result.keyLeft = parentNode.getCellDataRaw(cell);
-        result.recordLeft = parentNode.getCellRecordRaw(cell);
-    }
-    else if (p.second == parentNode.cellCount() - 1) {
-        CellId cellLeft = parentNode.cellId(parentNode.cellCount() - 2);
-        result.left = parentNode.getCellLeftPtrRaw(cellLeft);
-        result.keyLeft = parentNode.getCellDataRaw(cellLeft);
-        result.recordLeft = parentNode.getCellRecordRaw(cellLeft);
-        CellId cellRight = parentNode.cellId(parentNode.cellCount() - 1);
-        result.right = parentNode.rightPtr();
-        result.keyRight = parentNode.getCellDataRaw(cellRight);
-        result.recordRight = parentNode.getCellRecordRaw(cellRight);
-    }
-    else {
-        CellId cellLeft = parentNode.cellId(p.second - 1);
-        result.left = parentNode.getCellLeftPtrRaw(cellLeft);
-        result.keyLeft = parentNode.getCellDataRaw(cellLeft);
-        result.recordLeft = parentNode.getCellRecordRaw(cellLeft);
-        CellId cellRight = parentNode.cellId(p.second);
-        result.right = parentNode.getCellLeftPtr(p.second + 1);
-        result.keyRight = parentNode.getCellDataRaw(cellRight);
-        result.recordRight = parentNode.getCellRecordRaw(cellRight);
-    }
-    return result;
-};
-
-void InternalNode::insertIntoChild(char* key, RecordId record) {
-        pair<bool, SlotId> p = binarySearch(key, record);
-        NodeId currentId = rightPtr();
-        if (p.second != cellCount())
-            currentId = getCellLeftPtr(p.second);
-        LeafNode n(index, currentId, keySize);
-        n.insertIntoNode(key, record);
-        consistencyCheck();
-        internalConsistencyCheck();
-        n.consistencyCheck();
-}
-
-bool InternalNode::deleteFromNode(const char* key, RecordId record) {
-        pair<bool, SlotId> p = binarySearch(key, record);
-        if (p.first) {
-            NodeId childId = p.second == cellCount() ? rightPtr() : getCellLeftPtr(p.second);
-            Page childPage = index.retrieveRead(childId);
-            NodeId rightmostId = childId;
-            bool isChildEmpty;
-            if (childPage[0] == 0x01) { // Internal
-                InternalNode n(index, childId, keySize);
-                rightmostId = n.findRightmostNode();
-                isChildEmpty = n.cellCount() == 0;
-            }
-            else {
-                LeafNode n(index, childId, keySize);
-                isChildEmpty = n.cellCount() == 0;
-            }
-
-            CellId deletionPlace = cellId(p.second);
-            if (!isChildEmpty) {
-                LeafNode rightmost(index, rightmostId, keySize);
-                CellId rightmostCell = rightmost.cellId(rightmost.cellCount() - 1);
-                memcpy(getCellDataRaw(deletionPlace), rightmost.getCellDataRaw(rightmostCell), keySize);
-                getCellRecordRaw(deletionPlace) = rightmost.getCellRecordRaw(rightmostCell);
-                rightmost.deallocateCell(rightmostCell);
-                rightmost.cellCount()--;
-                index.update(rightmostId);
-            }
-            else {
-                index.deallocatePage(childId);
-                if (p.second != cellCount() - 1)
-                    memmove(&cellId(p.second), &cellId(p.second) + 1, (cellCount() - p.second - 1) * 2);
-                deallocateCell(deletionPlace);
-                cellCount()--;
-            }
-            index.update(id);
-            consistencyCheck();
-            return true;
-        }
-        else {
-            NodeId childId = p.second == cellCount() ? rightPtr() : getCellLeftPtr(p.second);
-            Page childPage = index.retrieveRead(childId);
-            if (childPage[0] == 0x01) { // Internal
-                InternalNode n(index, childId, keySize);
-                return n.deleteFromNode(key, record);
-            }
-            else { // Leaf
-                LeafNode n(index, childId, keySize);
-                return n.deleteFromNode(key, record);
-            }
-        }
-    }
\ No newline at end of file
@@ -0,0 +1,109 @@
+#include "Optimizer.h"
+
+#include <algorithm>
+
+// A column = column comparison with one column from each side, as (left column, right column)
+static bool isEquiKey(const QCondPtr& cond, int leftSize, pair<uint16_t, uint16_t>& key) {
+    auto cmpNode = convert<CompareConditionQNode>(cond);
+    if (!cmpNode || !cmpNode->equal || cmpNode->less || cmpNode->greater) return false;
+    auto leftColumn = convert<ColumnQNode>(cmpNode->left);
+    auto rightColumn = convert<ColumnQNode>(cmpNode->right);
+    if (!leftColumn || !rightColumn) return false;
+    if (leftColumn->columnId < leftSize && rightColumn->columnId >= leftSize)
+        key = make_pair(leftColumn->columnId, rightColumn->columnId - leftSize);
+    else if (rightColumn->columnId < leftSize && leftColumn->columnId >= leftSize)
+        key = make_pair(rightColumn->columnId, leftColumn->columnId - leftSize);
+    else
+        return false;
+    return true;
+}
+
+class JoinOptimizerVisitor : public QTableNode::RecursiveVisitor {
+private:
+    const SystemInfoManager& sysMan;
+
+    // Probes an index of the right table when its leading columns are join keys
+    void tryIndexLookup(JoinQNode& n) {
+        if (n.joinType != JoinType::Inner && n.joinType != JoinType::Left) return;
+        auto tableNode = convert<ReadTableQNode>(n.right);
+        if (!tableNode) return;
+        int bestCount = 0;
+        for (uint16_t indexId : sysMan.getTableInfo(tableNode->tableId).indexes) {
+            const auto& indexInfo = sysMan.getIndexInfo(tableNode->tableId, indexId);
+            const auto& columns = indexInfo.schema.columns;
+            vector<uint16_t> lookupColumns;
+            for (int i = 0; i < columns.size() - indexInfo.includeCount; i++) {
+                if (is<VariableLengthType>(columns[i].type)) break;
+                auto it = find_if(n.equiKeys.begin(), n.equiKeys.end(),
+                    [&](const pair<uint16_t, uint16_t>& p) { return p.second == columns[i].id; });
+                if (it == n.equiKeys.end()) break;
+                lookupColumns.push_back(it->first);
+            }
+            if (lookupColumns.size() <= bestCount) continue;
+            bestCount = lookupColumns.size();
+            n.method = JoinMethod::IndexLookup;
+            n.indexId = indexId;
+            n.keySchema = indexInfo.schema;
+            n.isUnique = indexInfo.isUnique;
+            n.lookupColumns = lookupColumns;
+        }
+    }
+    // Whether the rows come from an index scan ordered on the given table column,
+    // filters keep the order of their source
+    static bool isOrderedBy(const QTablePtr& node, uint16_t columnId) {
+        if (auto filter = convert<FilterQNode>(node))
+            return isOrderedBy(filter->source, columnId);
+        auto indexRead = convert<ReadTableIndexScanQNode>(node);
+        if (!indexRead) return false;
+        const auto& column = indexRead->keySchema.columns[0];
+        return !is<VariableLengthType>(column.type) && column.id == columnId;
+    }
+
+    // Merges both sides when the table reads below them already scan an index led by the same equi key
+    bool tryMerge(JoinQNode& n) {
+        for (int i = 0; i < n.equiKeys.size(); i++) {
+            if (!isOrderedBy(n.left, n.equiKeys[i].first) || !isOrderedBy(n.right, n.equiKeys[i].second))
+                continue;
+            swap(n.equiKeys[0], n.equiKeys[i]);
+            n.method = JoinMethod::Merge;
+            return true;
+        }
+        return false;
+    }
+public:
+    JoinOptimizerVisitor(const SystemInfoManager& sysMan) : RecursiveVisitor(nullptr), sysMan(sysMan) {}
+    virtual void visitJoinQNode(JoinQNode& n) {
+        RecursiveVisitor::visitJoinQNode(n);
+        if (n.joinType == JoinType::Cross || !n.on) return;
+        int leftSize = n.left->type.entries.size();
+        pair<uint16_t, uint16_t> key;
+        if (isEquiKey(n.on, leftSize, key)) {
+            n.equiKeys.push_back(key);
+            n.on = nullptr;
+        }
+        else if (auto andNode = convert<AndConditionQNode>(n.on)) {
+            vector<QCondPtr> rest;
+            for (auto& child : andNode->children) {
+                if (isEquiKey(child, leftSize, key))
+                    n.equiKeys.push_back(key);
+                else
+                    rest.push_back(move(child));
+            }
+            andNode->children = move(rest);
+            if (andNode->children.empty())
+                n.on = nullptr;
+            else if (andNode->children.size() == 1)
+                n.on = move(andNode->children[0]);
+        }
+        if (n.equiKeys.empty()) return;
+        n.method = JoinMethod::Hash;
+        tryIndexLookup(n);
+        if (n.method == JoinMethod::Hash)
+            tryMerge(n);
+    }
+};
+
+void optimizeJoins(QTablePtr& tree, const SystemInfoManager& sysMan) {
+    auto vis = make_unique<JoinOptimizerVisitor>(sysMan);
+    tree->accept(vis.get());
+}
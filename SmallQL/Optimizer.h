@@ -5,10 +5,12 @@
 
 void optimizeConstants(QTablePtr& tree);
 void optimizeConditions(QTablePtr& tree);
+void optimizeJoins(QTablePtr& tree, const SystemInfoManager& sysMan);
 void optimizeTableReads(QTablePtr& tree, const SystemInfoManager& sysMan);
 
 static inline void optimize(QTablePtr& tree, const SystemInfoManager& sysMan) {
     optimizeConstants(tree);
     optimizeConditions(tree);
     optimizeTableReads(tree, sysMan);
+    optimizeJoins(tree, sysMan);
 }
\ No newline at end of file
@@ -1,19 +1,22 @@
 #include "PageManager.h"
-#include <fstream>
 #include <iostream>
 
 static const VirtualFileID DELETED_FILE_ID = 0xFFFFFFF0;
 
-PageManager::PageManager(string filename, string metaFilename)
-    : f(nullptr), pageCount(0), metaFilename(metaFilename), metadataUpdated(false) {
-    fstream file(metaFilename, ios::binary | ios::out | ios::app);
-    file.close();
-    file.open(metaFilename, ios::binary | ios::in | ios::ate);
-    streamsize size = file.tellg();
-    file.seekg(0, std::ios::beg);
+PageManager::PageManager(string filename, string metaFilename, PageManagerConfig config)
+    : dataFile(filename, config.directIO), metaFile(metaFilename)
+    , checkpointLogSize(config.checkpointLogSize), commitsInProgress(0)
+    , frameCount(config.frameCount), clockHand(0)
+    , memoryMapped(config.memoryMapped), metadataUpdated(false), metadataWriting(false)
+    , dirtyHighWaterMark(config.dirtyHighWaterMark)
+    , writebackInterval(config.writebackInterval), writesInFlight(0), stopWriter(false) {
+    fileSize = dataFile.size();
+    // Frames never move, so the writer thread can use them without the lock
+    frames.reserve(frameCount);
 
+    uint64_t size = metaFile.size();
     std::vector<uint32_t> buffer(size / 4);
-    if (!file.read((char*)buffer.data(), size)) {
+    if (metaFile.read(0, (char*)buffer.data(), buffer.size() * 4) != buffer.size() * 4) {
         cout << "Can't open metadata file!" << endl;
         exit(1);
     }
@@ -23,151 +26,566 @@ PageManager::PageManager(string filename, string metaFilename)
             cout << "Metadata file is in invalid format!" << endl;
             exit(1);
         }
-        pageCount = buffer[1];
-
-        for (int i = 0; i < pageCount; i++) {
-            VirtualFileID id = buffer[i + 2];
-            if (id == DELETED_FILE_ID) {
-                deletedPages.insert(i);
-            }
-            else if (metadata.count(id) == 0) {
-                metadata.emplace(id, PageMap(1, i));
-            }
-            else {
-                metadata.at(id).push_back(i);
-            }
-        }
+        pageOwners.assign(buffer.begin() + 2, buffer.begin() + 2 + buffer[1]);
     }
     else {
         metadataUpdated = false;
     }
+    writtenPageCount = pageOwners.size();
 
+    if (config.writeAheadLog) {
+        wal = make_unique<WriteAheadLog>(filename.substr(0, filename.find_last_of('.')) + ".wal");
+        // Metadata blocks are recovered first, so page records resolve against the final map
+        wal->replay([&](const LogRecordHeader& record, const char* data) {
+            if (record.type != WriteAheadLog::META_RECORD) return;
+            size_t first = (size_t)record.pageId * META_BLOCK_ENTRIES;
+            size_t count = record.length / 4;
+            pageOwners.resize(max(pageOwners.size(), max((size_t)record.offset, first + count)), DELETED_FILE_ID);
+            memcpy(pageOwners.data() + first, data, record.length);
+            dirtyMetaBlocks.insert(record.pageId);
+            metadataUpdated = true;
+        });
+    }
 
-    int err = fopen_s(&f, filename.c_str(), "rb+");
-    if (err) {
-        fopen_s(&f, filename.c_str(), "wb");
-        fclose(f);
-        err = fopen_s(&f, filename.c_str(), "rb+");
-        if (err) {
-            cout << "Cannot open the Big File!" << endl;
-            exit(1);
+    freePages.resize(pageOwners.size());
+    for (PageId i = 0; i < pageOwners.size(); i++) {
+        VirtualFileID id = pageOwners[i];
+        if (id == DELETED_FILE_ID) {
+            freePages.setFree(i, true);
+        }
+        else if (metadata.count(id) == 0) {
+            metadata.emplace(id, PageMap(1, i));
+        }
+        else {
+            metadata.at(id).push_back(i);
         }
     }
+
+    if (wal) {
+        unique_lock<mutex> lock(pageMutex);
+        size_t replayed = wal->replay([&](const LogRecordHeader& record, const char* data) {
+            if (record.type == WriteAheadLog::META_RECORD) return;
+            if (record.type == WriteAheadLog::DELETE_RECORD) {
+                if (metadata.count(record.fileId) != 0)
+                    removeFile(lock, record.fileId, record.pageId);
+                return;
+            }
+            size_t index = fetchFrame(record.fileId, record.pageId);
+            memcpy(frames[index].data + record.offset, data, record.length);
+            markDirty(index);
+        });
+        lock.unlock();
+        if (replayed > 0 || metadataUpdated)
+            checkpoint();
+    }
+
+    writer = thread(&PageManager::writebackLoop, this);
 }
 
 PageManager::~PageManager() {
-    flushAll();
-    fclose(f);
+    {
+        lock_guard<mutex> lock(pageMutex);
+        stopWriter = true;
+    }
+    writerWakeup.notify_one();
+    writer.join();
+    checkpoint();
+    for (auto& frame : frames)
+        DiskFile::freeBuffer(frame.data);
+    for (Page buffer : spareBuffers)
+        DiskFile::freeBuffer(buffer);
+    for (char* chunk : mappedChunks)
+        if (chunk) DiskFile::unmap(chunk, MAP_CHUNK_PAGES * PAGE_SIZE);
 }
 
-PageId PageManager::getFreePage(bool hasMinPage, PageId minPage) const {
-    if (deletedPages.size() == 0) return pageCount++;
-    auto iter = hasMinPage? deletedPages.upper_bound(minPage) : deletedPages.begin();
-    PageId p = *iter;
-    deletedPages.erase(iter);
-    return p;
+PageId PageManager::getFreePage(const PageMap& pageMap) const {
+    // Metadata keeps the pages of a file in ascending order, so files only ever grow upwards
+    PageId from = pageMap.empty() ? 0 : pageMap.back() + 1;
+    // Files grow inside their last extent first, then take a whole free extent
+    PageId page = pageMap.empty() ? NULL32 : freePages.nextInExtent(pageMap.back());
+    if (page == NULL32)
+        page = freePages.findFreeExtent(from);
+    // Scattered free pages are only reused once they make up a sizable part of the file,
+    // and never from an extent another file is still growing into
+    if (page == NULL32 && freePages.freePages() > freePages.size() / 4) {
+        vector<bool> growing(freePages.extentCount(), false);
+        for (const auto& m : metadata) {
+            if (!m.second.empty() && &m.second != &pageMap)
+                growing[m.second.back() / EXTENT_PAGES] = true;
+        }
+        page = freePages.findFree(from, growing);
+    }
+    if (page == NULL32) {
+        PageId oldSize = freePages.size();
+        page = freePages.grow();
+        for (PageId i = oldSize; i < freePages.size(); i++)
+            setOwner(i, DELETED_FILE_ID);
+    }
+    freePages.setFree(page, false);
+    return page;
 }
 
-Page PageManager::retrieve(VirtualFileID fileId, PageId id) const {
+PageId PageManager::resolve(VirtualFileID fileId, PageId id) const {
     if (metadata.count(fileId) == 0) {
         metadata.emplace(fileId, PageMap());
     }
     auto& pageMap = metadata.at(fileId);
     while (pageMap.size() <= id) {
-        PageId minPage = pageMap.empty() ? 0 : pageMap.back();
-        pageMap.push_back(getFreePage(!pageMap.empty(), minPage));
-        metadataUpdated = true;
+        pageMap.push_back(getFreePage(pageMap));
+        setOwner(pageMap.back(), fileId);
     }
-    PageId trueId = pageMap[id];
+    return pageMap[id];
+}
 
-    auto i = cache.find(trueId);
-    if (i != cache.end()) {
-        return i->second.first;
+size_t PageManager::allocateFrame() const {
+    if (frames.size() < frameCount) {
+        frames.push_back(Frame{ NULL32, NULL32, NULL32, DiskFile::allocateBuffer(PAGE_SIZE), 0, false, false, false });
+        return frames.size() - 1;
     }
 
-    size_t offset = trueId * PAGE_SIZE;
-    fseek(f, offset, SEEK_SET);
-    Page p = new char[PAGE_SIZE];
+    for (size_t i = 0; i < 2 * frames.size(); i++) {
+        size_t index = clockHand;
+        clockHand = (clockHand + 1) % frames.size();
+        Frame& frame = frames[index];
+        if (frame.pinCount > 0) continue;
+        if (frame.referenced) {
+            frame.referenced = false;
+            continue;
+        }
+        if (frame.dirty)
+            writeFrame(frame);
+        if (frame.trueId != NULL32)
+            pageTable.erase(frame.fileId, frame.id);
+        frame.trueId = NULL32;
+        return index;
+    }
+    cout << "All buffer frames are pinned!" << endl;
+    exit(1);
+}
+
+size_t PageManager::fetchFrame(VirtualFileID fileId, PageId id, bool load) const {
+    const uint32_t* cached = pageTable.find(fileId, id);
+    if (cached) {
+        frames[*cached].referenced = true;
+        return *cached;
+    }
+
+    PageId trueId = resolve(fileId, id);
+    // Pages of deleted files stay cached (zeroed) until they are reused
+    cached = pageTable.find(DELETED_FILE_ID, trueId);
+    if (cached) {
+        size_t index = *cached;
+        pageTable.erase(DELETED_FILE_ID, trueId);
+        Frame& frame = frames[index];
+        frame.fileId = fileId;
+        frame.id = id;
+        frame.referenced = true;
+        pageTable.insert(fileId, id, index);
+        return index;
+    }
 
-    bool dirty = false;
-    if (!fread(p, PAGE_SIZE, 1, f)) {
-        if (feof(f)) {
-            memset(p, 0, PAGE_SIZE);
-            dirty = true;
-            dirtyQueue.push(trueId);
+    size_t index = allocateFrame();
+    Frame& frame = frames[index];
+    frame.fileId = fileId;
+    frame.id = id;
+    frame.trueId = trueId;
+    frame.pinCount = 0;
+    frame.dirty = false;
+    frame.referenced = true;
+
+    size_t count = load ? dataFile.read((uint64_t)trueId * PAGE_SIZE, frame.data, PAGE_SIZE) : 0;
+    if (count < PAGE_SIZE) {
+        memset(frame.data + count, 0, PAGE_SIZE - count);
+        markDirty(index);
+    }
+    pageTable.insert(fileId, id, index);
+    return index;
+}
+
+void PageManager::writeFrame(Frame& frame) const {
+    dataFile.write((uint64_t)frame.trueId * PAGE_SIZE, frame.data, PAGE_SIZE);
+    fileSize = max(fileSize, (uint64_t)(frame.trueId + 1) * PAGE_SIZE);
+    frame.dirty = false;
+    dirtyPages.erase(frame.trueId);
+}
+
+void PageManager::markDirty(size_t index) const {
+    Frame& frame = frames[index];
+    if (!frame.dirty) {
+        frame.dirty = true;
+        dirtyPages[frame.trueId] = index;
+        if (dirtyPages.size() >= dirtyHighWaterMark)
+            writerWakeup.notify_one();
+    }
+}
+
+void PageManager::waitWritable(unique_lock<mutex>& lock, size_t index) const {
+    writeDone.wait(lock, [&]() { return !frames[index].writing; });
+}
+
+Page PageManager::mappedPage(VirtualFileID fileId, PageId id) const {
+    if (!memoryMapped || pageTable.find(fileId, id)) return nullptr;
+    PageId trueId = resolve(fileId, id);
+    if (pageTable.find(DELETED_FILE_ID, trueId)) return nullptr;
+
+    size_t chunk = trueId / MAP_CHUNK_PAGES;
+    if (chunk >= mappedChunks.size())
+        mappedChunks.resize(chunk + 1, nullptr);
+    if (!mappedChunks[chunk]) {
+        // Only whole chunks backed by the file are mapped, the tail goes through frames
+        uint64_t chunkSize = MAP_CHUNK_PAGES * PAGE_SIZE;
+        if ((chunk + 1) * chunkSize > fileSize) return nullptr;
+        mappedChunks[chunk] = dataFile.map(chunk * chunkSize, chunkSize);
+        if (!mappedChunks[chunk]) {
+            memoryMapped = false;
+            return nullptr;
         }
-        else {
-            cout << "ERROR!" << endl;
-            exit(1);
+    }
+    return mappedChunks[chunk] + (size_t)(trueId % MAP_CHUNK_PAGES) * PAGE_SIZE;
+}
+
+Page PageManager::retrieve(VirtualFileID fileId, PageId id) const {
+    lock_guard<mutex> lock(pageMutex);
+    Page p = mappedPage(fileId, id);
+    if (p) return p;
+    return frames[fetchFrame(fileId, id)].data;
+}
+
+bool PageManager::pin(VirtualFileID fileId, PageId id) const {
+    lock_guard<mutex> lock(pageMutex);
+    // Mapped pages stay valid until the manager is destroyed
+    if (mappedPage(fileId, id)) return false;
+    frames[fetchFrame(fileId, id)].pinCount++;
+    return true;
+}
+
+void PageManager::advise(VirtualFileID fileId, AccessPattern pattern) const {
+    lock_guard<mutex> lock(pageMutex);
+    if (!memoryMapped) return;
+    auto m = metadata.find(fileId);
+    if (m == metadata.end()) return;
+    const PageMap& pageMap = m->second;
+    for (size_t i = 0; i < pageMap.size();) {
+        size_t j = i + 1;
+        while (j < pageMap.size() && pageMap[j] == pageMap[j - 1] + 1
+            && pageMap[j] / MAP_CHUNK_PAGES == pageMap[i] / MAP_CHUNK_PAGES)
+            j++;
+        size_t chunk = pageMap[i] / MAP_CHUNK_PAGES;
+        if (chunk < mappedChunks.size() && mappedChunks[chunk]) {
+            char* start = mappedChunks[chunk] + (size_t)(pageMap[i] % MAP_CHUNK_PAGES) * PAGE_SIZE;
+            DiskFile::advise(start, (j - i) * PAGE_SIZE, pattern);
+        }
+        i = j;
+    }
+}
+
+void PageManager::prefetch(VirtualFileID fileId, PageId first, PageId count) const {
+    vector<pair<PageId, PageId>> runs;
+    {
+        lock_guard<mutex> lock(pageMutex);
+        auto m = metadata.find(fileId);
+        if (m == metadata.end()) return;
+        const PageMap& pageMap = m->second;
+        PageId end = (PageId)min((size_t)first + count, pageMap.size());
+        for (PageId i = first; i < end; i++) {
+            PageId trueId = pageMap[i];
+            if (pageTable.find(fileId, i) || (uint64_t)trueId * PAGE_SIZE >= fileSize) continue;
+            if (!runs.empty() && runs.back().first + runs.back().second == trueId)
+                runs.back().second++;
+            else
+                runs.emplace_back(trueId, 1);
         }
     }
-    cache[trueId] = make_pair(p, dirty);
-    return p;
+    for (const auto& run : runs)
+        dataFile.prefetch((uint64_t)run.first * PAGE_SIZE, (size_t)run.second * PAGE_SIZE);
 }
 
-void PageManager::update(VirtualFileID fileId, PageId id) {
-    PageId trueId = metadata[fileId][id];
+void PageManager::unpin(VirtualFileID fileId, PageId id) const {
+    lock_guard<mutex> lock(pageMutex);
+    const uint32_t* cached = pageTable.find(fileId, id);
+    if (cached && frames[*cached].pinCount > 0)
+        frames[*cached].pinCount--;
+}
+
+Page PageManager::allocatePage() const {
+    {
+        lock_guard<mutex> lock(pageMutex);
+        if (!spareBuffers.empty()) {
+            Page p = spareBuffers.back();
+            spareBuffers.pop_back();
+            return p;
+        }
+    }
+    return DiskFile::allocateBuffer(PAGE_SIZE);
+}
+
+void PageManager::releasePage(Page page) {
+    lock_guard<mutex> lock(pageMutex);
+    spareBuffers.push_back(page);
+}
 
-    auto i = cache.find(trueId);
-    bool newDirty = true;
-    if (i == cache.end()) {
-        cache[trueId] = make_pair(new char[PAGE_SIZE](), true);
+void PageManager::install(const PageImage& page) {
+    unique_lock<mutex> lock(pageMutex);
+    size_t index = fetchFrame(page.fileId, page.id, false);
+    waitWritable(lock, index);
+    Frame& frame = frames[index];
+    // Pinned readers hold on to the frame buffer, so it can only be overwritten
+    if (frame.pinCount > 0) {
+        memcpy(frame.data, page.data, PAGE_SIZE);
+        spareBuffers.push_back(page.data);
     }
     else {
-        if (i->second.second)
-            newDirty = false;
-        i->second.second = true;
+        spareBuffers.push_back(frame.data);
+        frame.data = page.data;
+    }
+    markDirty(index);
+}
+
+void PageManager::logPage(const PageImage& page) {
+    if (!loggedPages.find(page.fileId, page.id)) {
+        // The first change after a checkpoint logs the whole page, so replay never depends on the disk image
+        wal->logPage(page.fileId, page.id, 0, page.data, PAGE_SIZE);
+        loggedPages.insert(page.fileId, page.id, true);
+        return;
     }
 
-    if (newDirty)
-        dirtyQueue.push(trueId);
+    const char* base = mappedPage(page.fileId, page.id);
+    if (!base) base = frames[fetchFrame(page.fileId, page.id)].data;
+    size_t i = 0;
+    while (i < PAGE_SIZE) {
+        if (base[i] == page.data[i]) {
+            i++;
+            continue;
+        }
+        // Short equal gaps are cheaper to log than a new record header
+        size_t start = i, end = i + 1, same = 0;
+        for (size_t j = end; j < PAGE_SIZE && same <= sizeof(LogRecordHeader); j++) {
+            if (base[j] != page.data[j]) {
+                end = j + 1;
+                same = 0;
+            }
+            else same++;
+        }
+        wal->logPage(page.fileId, page.id, start, page.data + start, end - start);
+        i = end;
+    }
 }
 
-bool PageManager::flushOne() {
-    if (dirtyQueue.empty()) return false;
-    PageId trueId = dirtyQueue.front();
-    dirtyQueue.pop();
+void PageManager::commit(const vector<PageImage>& pages) {
+    if (pages.empty()) return;
+    if (wal) {
+        LSN lsn;
+        {
+            lock_guard<mutex> lock(pageMutex);
+            for (const auto& page : pages)
+                logPage(page);
+            lsn = wal->logCommit();
+            commitsInProgress++;
+        }
+        wal->flush(lsn);
+    }
 
-    fseek(f, trueId * PAGE_SIZE, SEEK_SET);
-    fwrite(cache[trueId].first, 1, PAGE_SIZE, f);
-    cache[trueId].second = false;
+    for (const auto& page : pages)
+        install(page);
+
+    if (wal) {
+        {
+            lock_guard<mutex> lock(pageMutex);
+            commitsInProgress--;
+        }
+        if (wal->size() >= checkpointLogSize)
+            checkpoint();
+    }
 }
 
-void PageManager::flushMetadata() {
+void PageManager::checkpoint() {
+    unique_lock<mutex> lock(pageMutex);
+    while (!dirtyPages.empty())
+        writeFrame(frames[dirtyPages.begin()->second]);
+    writeDone.wait(lock, [&]() { return writesInFlight == 0; });
+    writeMetadata(lock);
+    if (!wal) return;
+
+    // The syncs run unlocked, so the log is only cut if nothing was logged meanwhile
+    LSN logEnd = wal->size();
+    bool isClean = dirtyPages.empty() && writesInFlight == 0 && !metadataUpdated && !metadataWriting;
+    lock.unlock();
+    metaFile.sync();
+    dataFile.sync();
+    lock.lock();
+    if (!isClean || commitsInProgress != 0 || wal->size() != logEnd) return;
+
+    // Pages logged after the cut need whole images again, a failed cut only costs larger records
+    loggedPages.clear();
+    commitsInProgress++;
+    lock.unlock();
+    wal->truncate(logEnd);
+    lock.lock();
+    commitsInProgress--;
+}
+
+size_t PageManager::writeBatch(unique_lock<mutex>& lock) {
+    vector<pair<PageId, uint32_t>> batch;
+    for (auto i = dirtyPages.begin(); i != dirtyPages.end() && batch.size() < WRITEBACK_BATCH_PAGES;) {
+        Frame& frame = frames[i->second];
+        frame.dirty = false;
+        frame.writing = true;
+        frame.pinCount++;
+        batch.push_back(*i);
+        i = dirtyPages.erase(i);
+    }
+    if (batch.empty()) return 0;
+    writesInFlight++;
+    lock.unlock();
+
+    // Runs of adjacent pages go out as one vectored write
+    vector<const char*> buffers;
+    for (size_t i = 0; i < batch.size();) {
+        size_t j = i + 1;
+        while (j < batch.size() && batch[j].first == batch[j - 1].first + 1) j++;
+        buffers.clear();
+        for (size_t k = i; k < j; k++)
+            buffers.push_back(frames[batch[k].second].data);
+        dataFile.write((uint64_t)batch[i].first * PAGE_SIZE, buffers, PAGE_SIZE);
+        i = j;
+    }
+
+    lock.lock();
+    for (const auto& p : batch) {
+        Frame& frame = frames[p.second];
+        frame.writing = false;
+        frame.pinCount--;
+    }
+    fileSize = max(fileSize, (uint64_t)(batch.back().first + 1) * PAGE_SIZE);
+    writesInFlight--;
+    writeDone.notify_all();
+    return batch.size();
+}
+
+void PageManager::writebackLoop() {
+    unique_lock<mutex> lock(pageMutex);
+    while (!stopWriter) {
+        bool pressure = writerWakeup.wait_for(lock, writebackInterval, [&]() {
+            return stopWriter || dirtyPages.size() >= dirtyHighWaterMark;
+        });
+        if (stopWriter) break;
+
+        // Under pressure write down to half the mark, otherwise drain everything
+        size_t target = pressure ? dirtyHighWaterMark / 2 : 0;
+        while (dirtyPages.size() > target && !stopWriter) {
+            if (writeBatch(lock) == 0) break;
+        }
+        if (dirtyPages.empty())
+            writeMetadata(lock);
+    }
+}
+
+void PageManager::setOwner(PageId page, VirtualFileID fileId) const {
+    if (page >= pageOwners.size())
+        pageOwners.resize(page + 1, DELETED_FILE_ID);
+    pageOwners[page] = fileId;
+    dirtyMetaBlocks.insert(page / META_BLOCK_ENTRIES);
+    metadataUpdated = true;
+}
+
+void PageManager::writeMetadata(unique_lock<mutex>& lock) {
+    // One writer at a time, so an older image never lands over a newer one
+    writeDone.wait(lock, [&]() { return !metadataWriting; });
     if (!metadataUpdated) return;
+    metadataWriting = true;
 
-    fstream file(metaFilename, ios::binary | ios::in | ios::out | ios::ate);
-    streamsize size = file.tellg();
-    if (size < 2) {
-        file.seekp(0, ios::beg);
-        uint32_t val = 0x4D446D53;
-        file.write((const char*)&val, 4);
-        file.write((const char*)&pageCount, 4);
+    // Dirty blocks are copied out, entries changed while they are written go out next time
+    uint32_t pageCount = pageOwners.size();
+    vector<pair<size_t, vector<VirtualFileID>>> blocks;
+    for (size_t block : dirtyMetaBlocks) {
+        auto first = pageOwners.begin() + block * META_BLOCK_ENTRIES;
+        auto last = pageOwners.begin() + min((block + 1) * META_BLOCK_ENTRIES, pageOwners.size());
+        blocks.emplace_back(block, vector<VirtualFileID>(first, last));
     }
-    else {
-        file.seekp(4, ios::beg);
-        file.write((const char*)&pageCount, 4);
-    }
-    vector<uint32_t> buffer(pageCount);
-    for (const auto& m : metadata) {
-        for (PageId id : m.second)
-                buffer[id] = m.first;
-    }
-    for (PageId id : deletedPages)
-            buffer[id] = DELETED_FILE_ID;
-    file.seekp(8, ios::beg);
-    file.write((const char*)buffer.data(), 4 * buffer.size());
+    dirtyMetaBlocks.clear();
     metadataUpdated = false;
+
+    LSN lsn = 0;
+    if (wal) {
+        // Blocks go to the log first, so a torn write to meta.dbm is repaired on replay
+        for (const auto& block : blocks)
+            wal->logMetadata(block.first, pageCount, (const char*)block.second.data(), block.second.size() * 4);
+        lsn = wal->logCommit();
+    }
+    lock.unlock();
+    if (wal)
+        wal->flush(lsn);
+
+    // Runs of adjacent blocks go out as one write
+    vector<VirtualFileID> run;
+    for (size_t i = 0; i < blocks.size();) {
+        size_t j = i + 1;
+        run = blocks[i].second;
+        for (; j < blocks.size() && blocks[j].first == blocks[j - 1].first + 1; j++)
+            run.insert(run.end(), blocks[j].second.begin(), blocks[j].second.end());
+        metaFile.write(8 + 4 * blocks[i].first * META_BLOCK_ENTRIES, (const char*)run.data(), 4 * run.size());
+        i = j;
+    }
+    // The header goes last, so it never covers entries that are not written yet
+    if (pageCount != writtenPageCount || metaFile.size() < 8) {
+        uint32_t header[2] = { 0x4D446D53, pageCount };
+        metaFile.write(0, (const char*)header, sizeof(header));
+        writtenPageCount = pageCount;
+    }
+
+    lock.lock();
+    metadataWriting = false;
+    writeDone.notify_all();
 }
 
-void PageManager::deleteFile(VirtualFileID fileId) {
+void PageManager::truncateFile(VirtualFileID fileId, PageId pageCount) {
+    unique_lock<mutex> lock(pageMutex);
+    auto m = metadata.find(fileId);
+    if (m == metadata.end() || (pageCount > 0 && m->second.size() <= pageCount)) return;
+    // Deallocation bypasses transactions, so it is committed to the log on its own,
+    // and the record must be durable before any freed page can be written over
+    if (wal) {
+        wal->logDelete(fileId, pageCount);
+        LSN lsn = wal->logCommit();
+        commitsInProgress++;
+        lock.unlock();
+        wal->flush(lsn);
+        lock.lock();
+        commitsInProgress--;
+        m = metadata.find(fileId);
+        if (m == metadata.end() || (pageCount > 0 && m->second.size() <= pageCount)) return;
+    }
+    removeFile(lock, fileId, pageCount);
+}
+
+void PageManager::removeFile(unique_lock<mutex>& lock, VirtualFileID fileId, PageId from) {
     auto& pageMap = metadata.at(fileId);
-    for (int i = 0; i < pageMap.size(); i++) {
-        Page p = retrieve(fileId, i);
-        memset(p, 0, PAGE_SIZE);
-        update(fileId, i);
-        deletedPages.insert(pageMap[i]);
+    for (PageId i = from; i < pageMap.size(); i++) {
+        loggedPages.erase(fileId, i);
+        const uint32_t* cached = pageTable.find(fileId, i);
+        size_t index;
+        if (cached) {
+            index = *cached;
+            pageTable.erase(fileId, i);
+        }
+        else {
+            index = allocateFrame();
+            frames[index].pinCount = 0;
+            frames[index].referenced = false;
+        }
+        waitWritable(lock, index);
+        Frame& frame = frames[index];
+        frame.fileId = DELETED_FILE_ID;
+        frame.id = pageMap[i];
+        frame.trueId = pageMap[i];
+        memset(frame.data, 0, PAGE_SIZE);
+        markDirty(index);
+        pageTable.insert(DELETED_FILE_ID, pageMap[i], index);
+        freePages.setFree(pageMap[i], true);
+        setOwner(pageMap[i], DELETED_FILE_ID);
     }
-    metadata.erase(fileId);
-    metadataUpdated = true;
-}
\ No newline at end of file
+    if (from == 0)
+        metadata.erase(fileId);
+    else if (from < pageMap.size())
+        pageMap.resize(from);
+}
@@ -1,42 +1,126 @@
 #pragma once
 
 #include "Common.h"
+#include "PageTable.h"
+#include "FreePageMap.h"
+#include "DiskFile.h"
+#include "WriteAheadLog.h"
 #include <cstdint>
-#include <cstdio>
 #include <vector>
 #include <set>
 #include <queue>
 #include <map>
 #include <string>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
 
 using VirtualFileID = uint32_t;
 const int PAGE_SIZE = 8192;
 using Page = char*;
 
+const size_t DEFAULT_FRAME_COUNT = 4096;
+const size_t MAP_CHUNK_PAGES = 1024;
+const size_t WRITEBACK_BATCH_PAGES = 256;
+const size_t META_BLOCK_ENTRIES = 1024;
+const PageId READ_AHEAD_PAGES = 64;
+
+struct PageManagerConfig {
+    size_t frameCount = DEFAULT_FRAME_COUNT;
+    bool directIO = false;
+    bool memoryMapped = false;
+    size_t dirtyHighWaterMark = 512;
+    chrono::milliseconds writebackInterval = chrono::milliseconds(500);
+    bool writeAheadLog = true;
+    uint64_t checkpointLogSize = 64 << 20;
+};
+
+struct PageImage {
+    VirtualFileID fileId;
+    PageId id;
+    Page data;
+};
+
 class PageManager {
 private:
     using PageMap = vector<PageId>;
+    struct Frame {
+        VirtualFileID fileId;
+        PageId id;
+        PageId trueId;
+        Page data;
+        uint32_t pinCount;
+        bool dirty;
+        bool referenced;
+        bool writing;
+    };
+
     mutable map<VirtualFileID, PageMap> metadata;
-    mutable set<PageId> deletedPages;
-    FILE* f;
-    mutable map<PageId, pair<Page, bool>> cache;
-    mutable queue<PageId> dirtyQueue;
-    mutable uint32_t pageCount;
+    mutable FreePageMap freePages;
+    // Image of the page-to-file map in meta.dbm, written back block by block
+    mutable vector<VirtualFileID> pageOwners;
+    mutable set<size_t> dirtyMetaBlocks;
+    uint32_t writtenPageCount;
+    DiskFile dataFile;
+    DiskFile metaFile;
+    unique_ptr<WriteAheadLog> wal;
+    uint64_t checkpointLogSize;
+    mutable PageTable<bool> loggedPages;
+    size_t commitsInProgress;
+    size_t frameCount;
+    mutable vector<Frame> frames;
+    mutable vector<Page> spareBuffers;
+    mutable PageTable<uint32_t> pageTable;
+    mutable size_t clockHand;
+    mutable map<PageId, uint32_t> dirtyPages;
+    mutable bool memoryMapped;
+    mutable vector<char*> mappedChunks;
+    mutable uint64_t fileSize;
     mutable bool metadataUpdated;
-    string metaFilename;
+    bool metadataWriting;
+
+    mutable mutex pageMutex;
+    mutable condition_variable writeDone;
+    mutable condition_variable writerWakeup;
+    size_t dirtyHighWaterMark;
+    chrono::milliseconds writebackInterval;
+    size_t writesInFlight;
+    bool stopWriter;
+    thread writer;
 
-    PageId getFreePage(bool hasMinPage, PageId minPage) const;
+    PageId getFreePage(const PageMap& pageMap) const;
+    PageId resolve(VirtualFileID fileId, PageId id) const;
+    size_t fetchFrame(VirtualFileID fileId, PageId id, bool load = true) const;
+    size_t allocateFrame() const;
+    void writeFrame(Frame& frame) const;
+    void markDirty(size_t index) const;
+    void waitWritable(unique_lock<mutex>& lock, size_t index) const;
+    Page mappedPage(VirtualFileID fileId, PageId id) const;
+    void setOwner(PageId page, VirtualFileID fileId) const;
+    void writeMetadata(unique_lock<mutex>& lock);
+    void install(const PageImage& page);
+    void logPage(const PageImage& page);
+    void removeFile(unique_lock<mutex>& lock, VirtualFileID fileId, PageId from);
+    size_t writeBatch(unique_lock<mutex>& lock);
+    void writebackLoop();
 public:
-    PageManager(string filename, string metaFilename);
+    PageManager(string filename, string metaFilename, PageManagerConfig config = PageManagerConfig());
     ~PageManager();
 
     Page retrieve(VirtualFileID fileId, PageId id) const;
-    void update(VirtualFileID fileId, PageId id);
-    void deleteFile(VirtualFileID fileId);
-    bool flushOne();
-    void flushMetadata();
-    inline void flushAll() {
-        while (flushOne()) {}
-        flushMetadata();
+    bool pin(VirtualFileID fileId, PageId id) const;
+    void unpin(VirtualFileID fileId, PageId id) const;
+    void advise(VirtualFileID fileId, AccessPattern pattern) const;
+    void prefetch(VirtualFileID fileId, PageId first, PageId count) const;
+    // Shadow page buffers, commit takes ownership of the committed ones
+    Page allocatePage() const;
+    void releasePage(Page page);
+    void commit(const vector<PageImage>& pages);
+    void checkpoint();
+    // Frees the pages of a file from the given one on, all of them deletes the file
+    void truncateFile(VirtualFileID fileId, PageId pageCount);
+    inline void deleteFile(VirtualFileID fileId) {
+        truncateFile(fileId, 0);
     }
-};
\ No newline at end of file
+};
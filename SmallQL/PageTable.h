@@ -0,0 +1,109 @@
+#pragma once
+
+#include "Common.h"
+#include <vector>
+
+// Open addressing hash table keyed by (file, page) pairs
+template<typename T>
+class PageTable {
+private:
+    static const uint64_t EMPTY_KEY = NULL64;
+    struct Slot {
+        uint64_t key;
+        T value;
+    };
+    vector<Slot> slots;
+    size_t count;
+
+    static inline uint64_t makeKey(uint32_t fileId, PageId id) {
+        return ((uint64_t)fileId << 32) | id;
+    }
+    static inline size_t hash(uint64_t key) {
+        key ^= key >> 33;
+        key *= 0xFF51AFD7ED558CCDull;
+        key ^= key >> 33;
+        return (size_t)key;
+    }
+    inline size_t mask() const { return slots.size() - 1; }
+
+    size_t findSlot(uint64_t key) const {
+        size_t i = hash(key) & mask();
+        while (slots[i].key != key && slots[i].key != EMPTY_KEY)
+            i = (i + 1) & mask();
+        return i;
+    }
+    void grow() {
+        vector<Slot> old(slots.size() * 2, Slot{ EMPTY_KEY, T() });
+        old.swap(slots);
+        for (auto& s : old) {
+            if (s.key == EMPTY_KEY) continue;
+            slots[findSlot(s.key)] = move(s);
+        }
+    }
+public:
+    PageTable(size_t capacity = 16) : count(0) {
+        size_t size = 16;
+        while (size < capacity * 2) size *= 2;
+        slots.assign(size, Slot{ EMPTY_KEY, T() });
+    }
+
+    inline size_t size() const { return count; }
+    inline bool empty() const { return count == 0; }
+
+    inline T* find(uint32_t fileId, PageId id) {
+        Slot& s = slots[findSlot(makeKey(fileId, id))];
+        return s.key == EMPTY_KEY ? nullptr : &s.value;
+    }
+    inline const T* find(uint32_t fileId, PageId id) const {
+        const Slot& s = slots[findSlot(makeKey(fileId, id))];
+        return s.key == EMPTY_KEY ? nullptr : &s.value;
+    }
+
+    T& insert(uint32_t fileId, PageId id, T value) {
+        if (2 * (count + 1) > slots.size()) grow();
+        uint64_t key = makeKey(fileId, id);
+        Slot& s = slots[findSlot(key)];
+        if (s.key == EMPTY_KEY) {
+            s.key = key;
+            count++;
+        }
+        s.value = move(value);
+        return s.value;
+    }
+
+    bool erase(uint32_t fileId, PageId id) {
+        size_t i = findSlot(makeKey(fileId, id));
+        if (slots[i].key == EMPTY_KEY) return false;
+        // Backward shift deletion keeps probe chains intact without tombstones
+        size_t j = i;
+        while (true) {
+            j = (j + 1) & mask();
+            if (slots[j].key == EMPTY_KEY) break;
+            size_t home = hash(slots[j].key) & mask();
+            if (((j - home) & mask()) >= ((j - i) & mask())) {
+                slots[i] = move(slots[j]);
+                i = j;
+            }
+        }
+        slots[i].key = EMPTY_KEY;
+        slots[i].value = T();
+        count--;
+        return true;
+    }
+
+    void clear() {
+        for (auto& s : slots) {
+            s.key = EMPTY_KEY;
+            s.value = T();
+        }
+        count = 0;
+    }
+
+    template<typename F>
+    void forEach(F f) {
+        for (auto& s : slots) {
+            if (s.key == EMPTY_KEY) continue;
+            f((uint32_t)(s.key >> 32), (PageId)s.key, s.value);
+        }
+    }
+};
@@ -84,7 +84,7 @@ public:
         cout << indent() << "]" << endl;
     }
     virtual void visitReadTableIndexScanQNode(ReadTableIndexScanQNode& n) {
-        cout << indent() << "IndexScan[" << endl;
+        cout << indent() << (n.isCovering ? "IndexOnlyScan[" : "IndexScan[") << endl;
         cout << indent1() << "tableId = " << n.tableId << ", ";
         cout << "indexId = " << n.indexId << endl;
         cout << indent1() << "Index: " << n.keySchema << endl;
@@ -161,8 +161,29 @@ public:
             cout << "Full";
             break;
         }
-        cout << "Join[" << endl;
+        switch (n.method)
+        {
+        case JoinMethod::NestedLoop:
+            cout << "Join[" << endl;
+            break;
+        case JoinMethod::Hash:
+            cout << "HashJoin[" << endl;
+            break;
+        case JoinMethod::IndexLookup:
+            cout << "IndexJoin[" << endl;
+            cout << indent1() << "indexId = " << n.indexId << endl;
+            break;
+        case JoinMethod::Merge:
+            cout << "MergeJoin[" << endl;
+            break;
+        }
         cout << indent1() << "Type: " << n.type << endl;
+        if (!n.equiKeys.empty()) {
+            cout << indent1() << "Keys: ";
+            for (const auto& p : n.equiKeys)
+                cout << "(" << p.first << ", " << p.second << ") ";
+            cout << endl;
+        }
         if (n.on) {
             cout << indent1() << "On: ";
             n.on->accept(condPrinter);
@@ -189,22 +210,14 @@ public:
         n.source->accept(this);
         level--;
     }
-    virtual void visitGroupifierQNode(GroupifierQNode& n) {
-        cout << indent() << "Groupifier[" << endl;
+    virtual void visitAggrFuncProjectionQNode(AggrFuncProjectionQNode& n) {
+        cout << indent1() << "AggrFuncProjection[" << endl;
         cout << indent1() << "Group plan: ";
         for (const auto& b : n.groupPlan) {
             cout << (b ? "G" : "_");
         }
         cout << endl;
         cout << indent1() << "Type: " << n.type << endl;
-        cout << indent() << "] <-" << endl;
-        level++;
-        n.source->accept(this);
-        level--;
-    }
-    virtual void visitAggrFuncProjectionQNode(AggrFuncProjectionQNode& n) {
-        cout << indent1() << "AggrFuncProjection[" << endl;
-        cout << indent1() << "Type: " << n.type << endl;
         cout << indent1() << "Funcs: " << endl;
         level++;
         for (auto& f : n.funcs) {
@@ -226,6 +239,27 @@ public:
         n.source->accept(this);
         level--;
     }
+    virtual void visitHashAggregateQNode(HashAggregateQNode& n) {
+        cout << indent() << "HashAggregate[" << endl;
+        cout << indent1() << "Group plan: ";
+        for (const auto& b : n.groupPlan) {
+            cout << (b ? "G" : "_");
+        }
+        cout << endl;
+        cout << indent1() << "Type: " << n.type << endl;
+        cout << indent1() << "Funcs: " << endl;
+        level++;
+        for (auto& f : n.funcs) {
+            cout << indent1();
+            f->accept(scalarPrinter);
+            cout << endl;
+        }
+        level--;
+        cout << indent() << "] <-" << endl;
+        level++;
+        n.source->accept(this);
+        level--;
+    }
     virtual void visitSelectorNode(SelectorNode& n) {
         cout << indent() << "SELECT" << endl;
         n.source->accept(this);
@@ -40,9 +40,9 @@ struct FilterQNode;
 struct UnionQNode;
 struct JoinQNode;
 struct SorterQNode;
-struct GroupifierQNode;
 struct AggrFuncProjectionQNode;
 struct DegroupifierQNode;
+struct HashAggregateQNode;
 struct SelectorNode;
 struct InserterNode;
 struct DeleterNode;
@@ -69,9 +69,9 @@ public:
     virtual void visitUnionQNode(UnionQNode& n) = 0;
     virtual void visitJoinQNode(JoinQNode& n) = 0;
     virtual void visitSorterQNode(SorterQNode& n) = 0;
-    virtual void visitGroupifierQNode(GroupifierQNode& n) = 0;
     virtual void visitAggrFuncProjectionQNode(AggrFuncProjectionQNode& n) = 0;
     virtual void visitDegroupifierQNode(DegroupifierQNode& n) = 0;
+    virtual void visitHashAggregateQNode(HashAggregateQNode& n) = 0;
     virtual void visitSelectorNode(SelectorNode& n) = 0;
     virtual void visitInserterNode(InserterNode& n) = 0;
     virtual void visitDeleterNode(DeleterNode& n) = 0;
@@ -111,7 +111,9 @@ struct ReadTableIndexScanQNode : public QTableNode {
     ValueArray from, to;
     bool incFrom, incTo;
     bool isUnique;
-    ReadTableIndexScanQNode() {}
+    // Everything read above the scan is in the index key, the table is never touched
+    bool isCovering;
+    ReadTableIndexScanQNode() : isCovering(false) {}
     virtual void accept(Visitor* v) {
         v->visitReadTableIndexScanQNode(*this);
     }
@@ -174,11 +176,29 @@ struct UnionQNode : public QTableNode {
     }
 };
 
+enum class JoinMethod {
+    NestedLoop,
+    Hash,
+    IndexLookup,
+    // Both sides come ordered on the first equi key
+    Merge,
+};
+
 struct JoinQNode : public QTableNode {
     JoinType joinType;
     QTablePtr left, right;
     QCondPtr on;
-    JoinQNode() {}
+    // Hash joins match the (left column, right column) pairs of equiKeys
+    // and check what is left in on for every match
+    JoinMethod method;
+    vector<pair<uint16_t, uint16_t>> equiKeys;
+    // Index lookup joins probe an index of the right table, which is read directly,
+    // with the left columns in lookupColumns as the leading key values
+    uint16_t indexId;
+    Schema keySchema;
+    bool isUnique;
+    vector<uint16_t> lookupColumns;
+    JoinQNode() : method(JoinMethod::NestedLoop), indexId(0), isUnique(false) {}
     virtual void accept(Visitor* v) {
         v->visitJoinQNode(*this);
     }
@@ -193,16 +213,9 @@ struct SorterQNode : public QTableNode {
     }
 };
 
-struct GroupifierQNode : public QTableNode {
-    vector<bool> groupPlan;
-    QTablePtr source;
-    GroupifierQNode() {}
-    virtual void accept(Visitor* v) {
-        v->visitGroupifierQNode(*this);
-    }
-};
-
+// Groups the sorted source by the group plan and computes the funcs per group
 struct AggrFuncProjectionQNode : public QTableNode {
+    vector<bool> groupPlan;
     vector<QScalarPtr> funcs;
     QTablePtr source;
     AggrFuncProjectionQNode() {}
@@ -219,6 +232,17 @@ struct DegroupifierQNode : public QTableNode {
     }
 };
 
+// Groups and aggregates in one pass through a hash table, the type is the one of a degroupifier
+struct HashAggregateQNode : public QTableNode {
+    vector<bool> groupPlan;
+    vector<QScalarPtr> funcs;
+    QTablePtr source;
+    HashAggregateQNode() {}
+    virtual void accept(Visitor* v) {
+        v->visitHashAggregateQNode(*this);
+    }
+};
+
 struct SelectorNode : public QTableNode {
     QTablePtr source;
     SelectorNode() {}
@@ -362,19 +386,19 @@ public:
         n.source->accept(this);
         qPtr = oldQPtr;
     }
-    virtual void visitGroupifierQNode(GroupifierQNode& n) {
+    virtual void visitAggrFuncProjectionQNode(AggrFuncProjectionQNode& n) {
         auto oldQPtr = qPtr;
         qPtr = &n.source;
         n.source->accept(this);
         qPtr = oldQPtr;
     }
-    virtual void visitAggrFuncProjectionQNode(AggrFuncProjectionQNode& n) {
+    virtual void visitDegroupifierQNode(DegroupifierQNode& n) {
         auto oldQPtr = qPtr;
         qPtr = &n.source;
         n.source->accept(this);
         qPtr = oldQPtr;
     }
-    virtual void visitDegroupifierQNode(DegroupifierQNode& n) {
+    virtual void visitHashAggregateQNode(HashAggregateQNode& n) {
         auto oldQPtr = qPtr;
         qPtr = &n.source;
         n.source->accept(this);
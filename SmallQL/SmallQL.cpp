@@ -16,8 +16,6 @@
 
 #include <set>
 #include <ctime>
-#include <thread>
-#include <future>
 
 int main()
 {
@@ -37,28 +35,17 @@ int main()
 
     while (true) {
         cout << "> ";
-        auto textFuture = async(launch::async, []() {
-            stringstream ss;
-            while (true) {
-                string s;
-                getline(cin, s);
-                ss << s << " ";
-                if (!s.empty() && s.back() == ';') break;
-                cout << ". ";
-            }
-            cout << endl;
-            return ss.str();
-        });
-
-        while (textFuture.wait_for(chrono::seconds(0)) != future_status::ready) {
-            bool flushed = trMan.flushOne();
-            if (!flushed) {
-                trMan.flushMetadata();
-                break;
-            }
+        stringstream ss;
+        while (true) {
+            string s;
+            getline(cin, s);
+            ss << s << " ";
+            if (!s.empty() && s.back() == ';') break;
+            cout << ". ";
         }
+        cout << endl;
 
-        string text = textFuture.get();
+        string text = ss.str();
         if (text.substr(0, 4) == "exit" || text.substr(0, 4) == "EXIT")
             break;
         try {
@@ -68,7 +55,7 @@ int main()
 
             bool success = true;
 
-            if (!tryDDL(parsed, trMan, sysMan)) {
+            if (!tryDDL(parsed, trMan, sysMan, blobManager)) {
                 auto qtree = parsed->algebrize(sysMan);
                 //cout << endl << "Before optimization:" << endl << endl;
                 //print(qtree);
@@ -240,6 +240,9 @@ void CreateIndexNode::prettyPrint(ostream& s, int level) const {
     for (auto const& c : columns) {
         s << indent1() << c << endl;
     }
+    for (auto const& c : includeColumns) {
+        s << indent1() << "INCLUDE " << c << endl;
+    }
     s << "}" << endl;
 }
 
@@ -247,6 +250,10 @@ void DropIndexNode::prettyPrint(ostream& s, int level) const {
     s << indent() << "DROP INDEX " << name << " ON " << tableName << endl;
 }
 
+void VacuumNode::prettyPrint(ostream& s, int level) const {
+    s << indent() << "VACUUM " << tableName << endl;
+}
+
 void ShowNode::prettyPrint(ostream& s, int level) const {
     s << indent() << "SHOW " << what;
     if (fromWhere != "")
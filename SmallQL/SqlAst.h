@@ -221,6 +221,8 @@ struct CreateIndexNode : public StatementNode {
     string name;
     string tableName;
     vector<string> columns;
+    // Stored in the index after the key columns so that scans can skip the table
+    vector<string> includeColumns;
     bool isUnique;
     virtual void prettyPrint(ostream& s, int level) const;
     virtual QTablePtr algebrize(const SystemInfoManager& sysMan) { return nullptr; };
@@ -233,6 +235,12 @@ struct DropIndexNode : public StatementNode {
     virtual QTablePtr algebrize(const SystemInfoManager& sysMan) { return nullptr; };
 };
 
+struct VacuumNode : public StatementNode {
+    string tableName;
+    virtual void prettyPrint(ostream& s, int level) const;
+    virtual QTablePtr algebrize(const SystemInfoManager& sysMan) { return nullptr; };
+};
+
 struct ShowNode : public StatementNode {
     string what;
     string fromWhere;
@@ -86,7 +86,7 @@ const static set<string> KEYWORDS_SET = {
     "NULL", "CROSS", "INNER", "LEFT", "RIGHT", "FULL", "JOIN", "ON",
     "ORDER", "BY", "ASC", "DESC", "GROUP", "DROP", "DELETE",
     "SHOW", "TABLES", "COLUMNS", "INDEXES", "UPDATE", "SET",
-    "BEGIN", "TRANSACTION", "COMMIT", "ROLLBACK"
+    "BEGIN", "TRANSACTION", "COMMIT", "ROLLBACK", "VACUUM", "INCLUDE"
 };
 
 const static set<string> TYPE_SET = {
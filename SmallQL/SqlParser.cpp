@@ -43,6 +43,9 @@ unique_ptr<StatementNode> Parser::parse() {
     else if (l.get().text == "SHOW") {
         return parseShow();
     }
+    else if (l.get().text == "VACUUM") {
+        return parseVacuum();
+    }
     else if (l.get().text == "BEGIN" || l.get().text == "COMMIT" || l.get().text == "ROLLBACK") {
         return parseTransactionOp();
     }
@@ -611,6 +614,20 @@ unique_ptr<CreateIndexNode> Parser::parseCreateIndex(bool isUnique) {
     }
     check(TokenType::RParen, "Expected right paren");
     l.advance();
+    if (l.get().isKeyword("INCLUDE")) {
+        l.advance();
+        check(TokenType::LParen, "Expected left paren");
+        l.advance();
+        while (l.get().type == TokenType::Id) {
+            result->includeColumns.push_back(l.pop().text);
+            if (l.get().type != TokenType::RParen) {
+                check(TokenType::Comma, "Expected comma");
+                l.advance();
+            }
+        }
+        check(TokenType::RParen, "Expected right paren");
+        l.advance();
+    }
     check(TokenType::Semicolon, "Expected semicolon");
     l.advance();
     return result;
@@ -630,6 +647,16 @@ unique_ptr<DropIndexNode> Parser::parseDropIndex() {
     return result;
 }
 
+unique_ptr<VacuumNode> Parser::parseVacuum() {
+    auto result = l.createPtr<VacuumNode>();
+    l.advance();
+    check(TokenType::Id, "Expected table name");
+    result->tableName = l.pop().text;
+    check(TokenType::Semicolon, "Expected semicolon");
+    l.advance();
+    return result;
+}
+
 unique_ptr<ShowNode> Parser::parseShow() {
     auto result = l.createPtr<ShowNode>();
     l.advance();
@@ -144,6 +144,7 @@ private:
     unique_ptr<ColumnSpecNode> parseColumnSpec();
     unique_ptr<CreateIndexNode> parseCreateIndex(bool isUnique);
     unique_ptr<DropIndexNode> parseDropIndex();
+    unique_ptr<VacuumNode> parseVacuum();
     unique_ptr<ShowNode> parseShow();
     unique_ptr<TransactionOpNode> parseTransactionOp();
 
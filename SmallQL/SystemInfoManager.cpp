@@ -108,8 +108,9 @@ void SystemInfoManager::load() {
         uint8_t flags = decoded[2].intVal;
         string indexName = decoded[3].stringVal;
         bool isUnique = flags & 0x1;
+        uint16_t includeCount = flags >> 1;
         indexNames[make_pair(tableId, indexName)] = indexId;
-        indexes[make_pair(tableId, indexId)] = IndexInfo{indexId, indexName, Schema(), isUnique};
+        indexes[make_pair(tableId, indexId)] = IndexInfo{indexId, indexName, Schema(), isUnique, includeCount};
         tables[tableId].indexes.insert(indexId);
     }
 
@@ -125,6 +126,17 @@ void SystemInfoManager::load() {
     for (auto& index : indexes) {
         index.second.schema.updateData(true);
     }
+
+    // Index files written with an older key format are rebuilt from their tables
+    for (const auto& index : indexes) {
+        uint16_t tableId = index.first.first;
+        uint16_t indexId = index.first.second;
+        if (IndexFile::isCurrent(trMan, tableId, indexId)) continue;
+        IndexFile::deleteFile(trMan, tableId, indexId);
+        IndexFile indexFile(trMan, tableId, indexId, index.second.schema, index.second.isUnique);
+        DataFile dataFile(trMan, *this, tableId);
+        indexFile.fillFrom(dataFile, tables[tableId].schema);
+    }
 }
 
 uint16_t SystemInfoManager::addTable(string name) {
@@ -186,7 +198,7 @@ void SystemInfoManager::createPrimaryIndex(uint16_t tableId) {
         });
         indexColumnsFile.addRecord(encoded.first);
     }
-    indexes[make_pair(tableId, 0)] = IndexInfo{ 0, "PRIMARY", keySchema, true};
+    indexes[make_pair(tableId, 0)] = IndexInfo{ 0, "PRIMARY", keySchema, true, 0};
     indexNames[make_pair(tableId, "PRIMARY")] = 0;
     tables[tableId].indexes.insert(0);
 
@@ -236,9 +248,11 @@ void SystemInfoManager::dropTable(string name) {
     }
 }
 
-void SystemInfoManager::createIndex(uint16_t tableId, string name, vector<string> columnNames, bool isUnique) {
+void SystemInfoManager::createIndex(uint16_t tableId, string name, vector<string> columnNames, bool isUnique,
+        vector<string> includeNames) {
     const Schema& tableSchema = tables[tableId].schema;
     Schema keySchema;
+    columnNames.insert(columnNames.end(), includeNames.begin(), includeNames.end());
     for (string column : columnNames) {
         makeUpper(column);
         bool found = false;
@@ -258,7 +272,8 @@ void SystemInfoManager::createIndex(uint16_t tableId, string name, vector<string
     DataFile indexesFile(trMan, -3, indexesSchema.getSize());
     DataFile indexColumnsFile(trMan, -4, indexColumnsSchema.getSize());
 
-    int8_t flags = isUnique ? 0x01 : 0x00;
+    // Bit 0 is the unique flag, the rest is the number of included columns
+    int8_t flags = (isUnique ? 0x01 : 0x00) | (int8_t)(includeNames.size() << 1);
     
     uint16_t indexId = 0;
     while (tables[tableId].indexes.count(indexId) > 0) indexId++;
@@ -273,7 +288,7 @@ void SystemInfoManager::createIndex(uint16_t tableId, string name, vector<string
         });
         indexColumnsFile.addRecord(encoded.first);
     }
-    indexes[make_pair(tableId, indexId)] = IndexInfo{ indexId, name, keySchema, isUnique};
+    indexes[make_pair(tableId, indexId)] = IndexInfo{ indexId, name, keySchema, isUnique, (uint16_t)includeNames.size()};
     indexNames[make_pair(tableId, name)] = indexId;
     tables[tableId].indexes.insert(indexId);
     IndexFile index(trMan, tableId, indexId, keySchema, isUnique);
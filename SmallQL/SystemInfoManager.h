@@ -17,6 +17,8 @@ struct IndexInfo {
     string name;
     Schema schema;
     bool isUnique;
+    // The last columns of the schema are included ones, they are stored but not searched by
+    uint16_t includeCount;
 };
 
 class SystemInfoManager {
@@ -36,7 +38,8 @@ public:
     uint16_t addColumn(uint16_t tableId, string name, string type, bool isPrimary, bool canBeNull, string defaultValue="");
     void dropTable(string name);
     void createPrimaryIndex(uint16_t tableId);
-    void createIndex(uint16_t tableId, string name, vector<string> columnNames, bool isUnique);
+    void createIndex(uint16_t tableId, string name, vector<string> columnNames, bool isUnique,
+        vector<string> includeNames = vector<string>());
     void dropIndex(uint16_t tableId, string name);
 
     inline bool tableExists(string name) const {
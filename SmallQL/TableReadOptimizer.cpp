@@ -40,15 +40,33 @@ bool isCompareCondOptimizableWithIndex(
     return fitsWith(cond, keySchema.columns[0].id);
 }
 
-bool isAndCondOptimizableWithIndex(
+// Number of leading key columns the conditions bound: columns compared for equality,
+// then at most one column with a range. Matched conditions go to the map as
+// condition number -> (key column, isReversed)
+int matchIndexColumns(
     const vector<QCondPtr>& children,
-    const Schema& keySchema) {
-    for (auto& child : children) {
-        auto casted = convert<CompareConditionQNode>(child);
-        if (casted && isCompareCondOptimizableWithIndex(*casted, keySchema))
-            return true;
+    const Schema& keySchema,
+    map<int, pair<int, bool>>* matched = nullptr) {
+    int column = 0;
+    while (column < keySchema.columns.size()) {
+        bool hasMatch = false, hasEquality = false;
+        for (int i = 0; i < children.size(); i++) {
+            auto cmpNode = convert<CompareConditionQNode>(children[i]);
+            if (!cmpNode) continue;
+            bool isReversed;
+            if (fitsWith(*cmpNode, keySchema.columns[column].id, &isReversed)) {
+                hasMatch = true;
+                if (matched)
+                    matched->emplace(i, make_pair(column, isReversed));
+                if (cmpNode->equal && !cmpNode->greater && !cmpNode->less)
+                    hasEquality = true;
+            }
+        }
+        if (!hasMatch) break;
+        column++;
+        if (!hasEquality) break;
     }
-    return false;
+    return column;
 }
 
 class WhereConditionOptimizableVisitor : public QConditionNode::Visitor {
@@ -62,15 +80,23 @@ public:
     WhereConditionOptimizableVisitor(uint16_t tableId, const SystemInfoManager& sysMan)
         : tableId(tableId), sysMan(sysMan), result(false) {}
     virtual void visitAndConditionQNode(AndConditionQNode& n) {
+        // The index with the most bounded columns gives the narrowest scan
+        int bestColumns = 0;
+        uint16_t bestIndexId = 0;
         for (uint16_t indexId : sysMan.getTableInfo(tableId).indexes) {
             const Schema& keySchema = sysMan.getIndexSchema(tableId, indexId);
-            if (isAndCondOptimizableWithIndex(n.children, keySchema)) {
-                result = true;
-                auto decision = OptimizationDecision{ OptimizationOption::IndexifyAnd, indexId };
-                plan.emplace(&n, decision);
-                return;
+            int columns = matchIndexColumns(n.children, keySchema);
+            if (columns > bestColumns) {
+                bestColumns = columns;
+                bestIndexId = indexId;
             }
         }
+        if (bestColumns > 0) {
+            result = true;
+            auto decision = OptimizationDecision{ OptimizationOption::IndexifyAnd, bestIndexId };
+            plan.emplace(&n, decision);
+            return;
+        }
         for (uint16_t i = 0; i < n.children.size(); i++) {
             auto casted = convert<OrConditionQNode>(n.children[i]);
             if (casted) {
@@ -129,26 +155,12 @@ private:
         uint16_t indexId = plan.at(&n).indexId;
         const auto& indexInfo = sysMan.getIndexInfo(tableId, indexId);
         const Schema& indexSchema = indexInfo.schema;
-        int currentFieldIndex = 0;
-        while (currentFieldIndex < indexSchema.columns.size()) {
-            bool shouldMoveIndex = false;
-            for (int i = 0; i < n.children.size(); i++) {
-                auto cmpNode = convert<CompareConditionQNode>(n.children[i]);
-                if (!cmpNode) continue;
-                bool isReversed;
-                if (fitsWith(*cmpNode, indexSchema.columns[currentFieldIndex].id, &isReversed)) {
-                    indexifyable.emplace(i, make_pair(currentFieldIndex, isReversed));
-                    if (cmpNode->equal && !cmpNode->greater && !cmpNode->less)
-                        shouldMoveIndex = true;
-                }
-            }
-            if (!shouldMoveIndex) break;
-            else currentFieldIndex++;
-        }
+        int boundColumns = matchIndexColumns(n.children, indexSchema, &indexifyable);
 
         ValueArray from(indexSchema.columns.size(), Value(ValueType::MinVal));
         ValueArray to(indexSchema.columns.size(), Value(ValueType::MaxVal));
-        bool incFrom = false, incTo = false;
+        vector<bool> incFromAt(indexSchema.columns.size(), false);
+        vector<bool> incToAt(indexSchema.columns.size(), false);
         for (const auto& p : indexifyable) {
             auto cmpNode = convert<CompareConditionQNode>(n.children[p.first]);
             int fieldId = p.second.first;
@@ -160,18 +172,49 @@ private:
             bool isGreater = isReversed ? cmpNode->less : cmpNode->greater;
             bool isOnlyEqual = isEqual && !isLess && !isGreater;
             if (isGreater || isOnlyEqual) {
-                if (compareValue(from[fieldId], constValue) < 0) {
+                int r = compareValue(from[fieldId], constValue);
+                if (r < 0 || (r == 0 && !isEqual)) {
                     from[fieldId] = constValue;
-                    incFrom = isEqual;
+                    incFromAt[fieldId] = isEqual;
                 }
             }
             if (isLess || isOnlyEqual) {
-                if (compareValue(to[fieldId], constValue) > 0) {
+                int r = compareValue(to[fieldId], constValue);
+                if (r > 0 || (r == 0 && !isEqual)) {
                     to[fieldId] = constValue;
-                    incTo = isEqual;
+                    incToAt[fieldId] = isEqual;
                 }
             }
         }
+        // A bound ends at the last column it sets, or earlier at a column it excludes,
+        // and takes its inclusiveness from there
+        int fromEnd = 0, toEnd = 0;
+        bool incFrom = false, incTo = false;
+        while (fromEnd < boundColumns && from[fromEnd].type != ValueType::MinVal) {
+            incFrom = incFromAt[fromEnd++];
+            if (!incFrom) break;
+        }
+        while (toEnd < boundColumns && to[toEnd].type != ValueType::MaxVal) {
+            incTo = incToAt[toEnd++];
+            if (!incTo) break;
+        }
+        for (int i = fromEnd; i < boundColumns; i++)
+            from[i] = Value(ValueType::MinVal);
+        for (int i = toEnd; i < boundColumns; i++)
+            to[i] = Value(ValueType::MaxVal);
+        // Conditions on the columns cut off from a bound stay in the filter
+        for (auto it = indexifyable.begin(); it != indexifyable.end();) {
+            auto cmpNode = convert<CompareConditionQNode>(n.children[it->first]);
+            int fieldId = it->second.first;
+            bool isReversed = it->second.second;
+            bool isOnlyEqual = cmpNode->equal && !cmpNode->less && !cmpNode->greater;
+            bool isLess = isReversed ? cmpNode->greater : cmpNode->less;
+            bool isGreater = isReversed ? cmpNode->less : cmpNode->greater;
+            if (((isGreater || isOnlyEqual) && fieldId >= fromEnd) || ((isLess || isOnlyEqual) && fieldId >= toEnd))
+                it = indexifyable.erase(it);
+            else
+                it++;
+        }
 
         auto indexRead = make_unique<ReadTableIndexScanQNode>();
         indexRead->tableId = tableId;
@@ -281,6 +324,7 @@ public:
         indexRead->incTo = incTo;
         indexRead->tableSchema = sysMan.getTableSchema(tableId);
         indexRead->type = IntermediateType(indexRead->tableSchema, sysMan.getTableInfo(tableId).name);
+        indexRead->isUnique = sysMan.getIndexInfo(tableId, indexId).isUnique;
         result = move(indexRead);
     }
     inline QTablePtr getResult() {
@@ -312,7 +356,143 @@ public:
     }
 };
 
+class UsedColumnsScalarVisitor : public QScalarNode::RecursiveVisitor {
+private:
+    vector<bool>& used;
+public:
+    UsedColumnsScalarVisitor(vector<bool>& used) : used(used) {}
+    virtual void visitColumnQNode(ColumnQNode& n) {
+        used[n.columnId] = true;
+    }
+};
+
+class UsedColumnsCondVisitor : public QConditionNode::RecursiveVisitor {
+private:
+    UsedColumnsScalarVisitor scalarVisitor;
+public:
+    UsedColumnsCondVisitor(vector<bool>& used) : scalarVisitor(used) {}
+    virtual void visitCompareConditionQNode(CompareConditionQNode& n) {
+        n.left->accept(&scalarVisitor);
+        n.right->accept(&scalarVisitor);
+    }
+};
+
+// Walks down the tree tracking which columns of each node are read above it,
+// index scans that only need their key columns skip the table
+class CoveringScanVisitor : public QTableNode::Visitor {
+private:
+    vector<bool> used;
+
+    void markScalar(QScalarNode& n) {
+        UsedColumnsScalarVisitor vis(used);
+        n.accept(&vis);
+    }
+    void markCondition(QConditionNode& n) {
+        UsedColumnsCondVisitor vis(used);
+        n.accept(&vis);
+    }
+public:
+    virtual void visitReadTableQNode(ReadTableQNode& n) {}
+    virtual void visitReadTableIndexScanQNode(ReadTableIndexScanQNode& n) {
+        vector<bool> inKey(used.size(), false);
+        for (const auto& column : n.keySchema.columns) {
+            if (!is<VariableLengthType>(column.type))
+                inKey[column.id] = true;
+        }
+        n.isCovering = true;
+        for (int i = 0; i < used.size(); i++) {
+            if (used[i] && !inKey[i])
+                n.isCovering = false;
+        }
+    }
+    virtual void visitProjectionQNode(ProjectionQNode& n) {
+        vector<bool> sourceUsed(n.source->type.entries.size(), false);
+        for (int i = 0; i < n.columns.size(); i++) {
+            if (used[i])
+                sourceUsed[n.columns[i]] = true;
+        }
+        used = sourceUsed;
+        n.source->accept(this);
+    }
+    virtual void visitFuncProjectionQNode(FuncProjectionQNode& n) {
+        used.resize(n.source->type.entries.size());
+        for (auto& func : n.funcs)
+            markScalar(*func);
+        n.source->accept(this);
+    }
+    virtual void visitFilterQNode(FilterQNode& n) {
+        markCondition(*n.cond);
+        n.source->accept(this);
+    }
+    virtual void visitUnionQNode(UnionQNode& n) {
+        vector<bool> unionUsed = used;
+        for (auto& source : n.sources) {
+            used = unionUsed;
+            source->accept(this);
+        }
+    }
+    virtual void visitJoinQNode(JoinQNode& n) {
+        if (n.on)
+            markCondition(*n.on);
+        size_t leftSize = n.left->type.entries.size();
+        for (const auto& p : n.equiKeys) {
+            used[p.first] = true;
+            used[leftSize + p.second] = true;
+        }
+        vector<bool> rightUsed(used.begin() + leftSize, used.end());
+        used.resize(leftSize);
+        n.left->accept(this);
+        used = rightUsed;
+        n.right->accept(this);
+    }
+    virtual void visitSorterQNode(SorterQNode& n) {
+        for (const auto& p : n.cmpPlan)
+            used[p.first] = true;
+        n.source->accept(this);
+    }
+    virtual void visitAggrFuncProjectionQNode(AggrFuncProjectionQNode& n) {
+        used.resize(n.source->type.entries.size());
+        for (int i = 0; i < n.groupPlan.size(); i++) {
+            if (n.groupPlan[i])
+                used[i] = true;
+        }
+        for (auto& func : n.funcs)
+            markScalar(*func);
+        n.source->accept(this);
+    }
+    // Grouped columns and aggregates are marked by the projection below
+    virtual void visitDegroupifierQNode(DegroupifierQNode& n) {
+        used.assign(n.source->type.entries.size(), false);
+        n.source->accept(this);
+    }
+    virtual void visitHashAggregateQNode(HashAggregateQNode& n) {
+        used.assign(n.source->type.entries.size(), false);
+        for (int i = 0; i < n.groupPlan.size(); i++) {
+            if (n.groupPlan[i])
+                used[i] = true;
+        }
+        for (auto& func : n.funcs)
+            markScalar(*func);
+        n.source->accept(this);
+    }
+    virtual void visitSelectorNode(SelectorNode& n) {
+        used.assign(n.source->type.entries.size(), true);
+        n.source->accept(this);
+    }
+    virtual void visitInserterNode(InserterNode& n) {
+        used.assign(n.source->type.entries.size(), true);
+        n.source->accept(this);
+    }
+    // Deletes and updates work on whole records
+    virtual void visitDeleterNode(DeleterNode& n) {}
+    virtual void visitUpdaterNode(UpdaterNode& n) {}
+    virtual void visitExprDataNode(ExprDataNode& n) {}
+    virtual void visitConstDataNode(ConstDataNode& n) {}
+};
+
 void optimizeTableReads(QTablePtr& tree, const SystemInfoManager& sysMan) {
     auto vis = make_unique<TableReadVisitor>(&tree, sysMan);
     tree->accept(vis.get());
+    auto coveringVis = make_unique<CoveringScanVisitor>();
+    tree->accept(coveringVis.get());
 }
\ No newline at end of file
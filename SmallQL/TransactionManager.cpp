@@ -1,38 +1,43 @@
 #include "TransactionManager.h"
 
 Page TransactionManager::retrieveRead(VirtualFileID fileId, PageId id) const {
-    PagePair p = make_pair(fileId, id);
-    if (transactionPages.count(p) != 0)
-        return transactionPages[p].first;
-    else
-        return pageManager.retrieve(fileId, id);
+    if (!transactionPages.empty()) {
+        auto p = transactionPages.find(fileId, id);
+        if (p) return p->first;
+    }
+    return pageManager.retrieve(fileId, id);
 }
 
 Page TransactionManager::retrieveWrite(VirtualFileID fileId, PageId id) const {
-    PagePair p = make_pair(fileId, id);
-    if (transactionPages.count(p) != 0)
-        return transactionPages[p].first;
+    auto p = transactionPages.find(fileId, id);
+    if (p) return p->first;
     
-    Page copy = new char[PAGE_SIZE];
+    Page copy = pageManager.allocatePage();
     memcpy(copy, pageManager.retrieve(fileId, id), PAGE_SIZE);
-    transactionPages[p] = make_pair(copy, false);
+    transactionPages.insert(fileId, id, make_pair(copy, false));
     return copy;
 }
 
 void TransactionManager::update(VirtualFileID fileId, PageId id) {
-    transactionPages[make_pair(fileId, id)].second = true;
+    auto p = transactionPages.find(fileId, id);
+    if (p) p->second = true;
 }
 
 void TransactionManager::commit() {
-    for (const auto& p : transactionPages) {
-        if (!p.second.second) continue;
-        Page actualPage = pageManager.retrieve(p.first.first, p.first.second);
-        memcpy(actualPage, p.second.first, PAGE_SIZE);
-        pageManager.update(p.first.first, p.first.second);
-    }
+    vector<PageImage> pages;
+    transactionPages.forEach([&](VirtualFileID fileId, PageId id, pair<Page, bool>& p) {
+        if (p.second)
+            pages.push_back(PageImage{ fileId, id, p.first });
+        else
+            pageManager.releasePage(p.first);
+    });
+    pageManager.commit(pages);
     transactionPages.clear();
 }
 
 void TransactionManager::rollback() {
+    transactionPages.forEach([&](VirtualFileID, PageId, pair<Page, bool>& p) {
+        pageManager.releasePage(p.first);
+    });
     transactionPages.clear();
 }
\ No newline at end of file
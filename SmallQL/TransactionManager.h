@@ -4,36 +4,128 @@
 
 class TransactionManager {
 private:
-    using PagePair = pair<VirtualFileID, PageId>;
     PageManager pageManager;
-    mutable map<PagePair, pair<Page, bool>> transactionPages;
+    mutable PageTable<pair<Page, bool>> transactionPages;
 public:
-    TransactionManager(string filename, string metaFilename)
-        : pageManager(filename, metaFilename) {}
+    TransactionManager(string filename, string metaFilename, PageManagerConfig config = PageManagerConfig())
+        : pageManager(filename, metaFilename, config) {}
 
     Page retrieveRead(VirtualFileID fileId, PageId id) const;
     Page retrieveWrite(VirtualFileID fileId, PageId id) const;
     void update(VirtualFileID fileId, PageId id);
+    inline bool pin(VirtualFileID fileId, PageId id) const { return pageManager.pin(fileId, id); }
+    inline void unpin(VirtualFileID fileId, PageId id) const { pageManager.unpin(fileId, id); }
+    inline void advise(VirtualFileID fileId, AccessPattern pattern) const { pageManager.advise(fileId, pattern); }
+    inline void prefetch(VirtualFileID fileId, PageId first, PageId count) const { pageManager.prefetch(fileId, first, count); }
     inline void deleteFile(VirtualFileID fileId) { pageManager.deleteFile(fileId); }
-    inline bool flushOne() { return pageManager.flushOne(); }
-    inline void flushMetadata() { pageManager.flushMetadata(); }
-    inline void flushAll() { pageManager.flushAll(); }
+    inline void truncateFile(VirtualFileID fileId, PageId pageCount) { pageManager.truncateFile(fileId, pageCount); }
 
     void commit();
     void rollback();
 };
 
+// Keeps one page resident for as long as the handle lives, copies pin the page again
+class PageHandle {
+private:
+    const TransactionManager* trMan;
+    VirtualFileID fileId;
+    PageId id;
+    bool pinned;
+    Page page;
+
+    inline void release() {
+        if (pinned)
+            trMan->unpin(fileId, id);
+        pinned = false;
+    }
+public:
+    PageHandle()
+        : trMan(nullptr), fileId(0), id(NULL32), pinned(false), page(nullptr) {}
+    PageHandle(const TransactionManager& trMan, VirtualFileID fileId, PageId id)
+        : trMan(&trMan), fileId(fileId), id(id)
+        , pinned(trMan.pin(fileId, id)), page(trMan.retrieveRead(fileId, id)) {}
+    PageHandle(const PageHandle& other)
+        : trMan(other.trMan), fileId(other.fileId), id(other.id)
+        , pinned(other.pinned && trMan->pin(fileId, id)), page(other.page) {}
+    PageHandle(PageHandle&& other) noexcept
+        : trMan(other.trMan), fileId(other.fileId), id(other.id)
+        , pinned(other.pinned), page(other.page) {
+        other.pinned = false;
+    }
+    ~PageHandle() {
+        release();
+    }
+    PageHandle& operator=(const PageHandle& other) {
+        if (this != &other)
+            *this = PageHandle(other);
+        return *this;
+    }
+    PageHandle& operator=(PageHandle&& other) noexcept {
+        if (this != &other) {
+            release();
+            trMan = other.trMan;
+            fileId = other.fileId;
+            id = other.id;
+            pinned = other.pinned;
+            page = other.page;
+            other.pinned = false;
+        }
+        return *this;
+    }
+
+    inline Page get() const {
+        return page;
+    }
+    inline PageId getId() const {
+        return id;
+    }
+};
+
 class Pager {
 private:
     TransactionManager& trMan;
     VirtualFileID fileId;
+    mutable PageHandle lastRead;
+    mutable PageId lastPage;
+    mutable PageId sequentialRun;
+    mutable PageId prefetchedUntil;
+
+    // After a couple of steps to the next page, keeps the pages ahead of the reader on their way in
+    inline void readAhead(PageId id) const {
+        if (id == lastPage) return;
+        if (lastPage == NULL32 || id != lastPage + 1) {
+            sequentialRun = 0;
+            prefetchedUntil = 0;
+        }
+        else if (++sequentialRun >= 2 && id + READ_AHEAD_PAGES / 2 >= prefetchedUntil) {
+            PageId from = max(id + 1, prefetchedUntil);
+            trMan.prefetch(fileId, from, id + 1 + READ_AHEAD_PAGES - from);
+            prefetchedUntil = id + 1 + READ_AHEAD_PAGES;
+        }
+        lastPage = id;
+    }
 public:
     Pager(TransactionManager& trMan, VirtualFileID fileId)
-        : trMan(trMan), fileId(fileId) {}
+        : trMan(trMan), fileId(fileId), lastPage(NULL32)
+        , sequentialRun(0), prefetchedUntil(0) {}
+    Pager(const Pager& other)
+        : trMan(other.trMan), fileId(other.fileId), lastPage(NULL32)
+        , sequentialRun(0), prefetchedUntil(0) {}
 
+    // Pins the page for as long as the returned handle lives
+    inline PageHandle readHandle(PageId id) const {
+        readAhead(id);
+        return PageHandle(trMan, fileId, id);
+    }
+    // Short reads only: the page stays resident until the next retrieveRead through this pager
     inline Page retrieveRead(PageId id) const {
+        if (id != lastRead.getId())
+            lastRead = readHandle(id);
         return trMan.retrieveRead(fileId, id);
     }
+    inline void advise(AccessPattern pattern) const {
+        trMan.advise(fileId, pattern);
+    }
     inline Page retrieveWrite(PageId id) const {
         return trMan.retrieveWrite(fileId, id);
     }
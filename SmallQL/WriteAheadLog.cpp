@@ -0,0 +1,121 @@
+#include "WriteAheadLog.h"
+#include <cstring>
+
+static uint32_t checksum(const char* data, size_t size, uint32_t hash = 0x811C9DC5u) {
+    for (size_t i = 0; i < size; i++) {
+        hash ^= (uint8_t)data[i];
+        hash *= 0x01000193u;
+    }
+    return hash;
+}
+
+static uint32_t recordChecksum(const LogRecordHeader& header, const char* data) {
+    uint32_t hash = checksum((const char*)&header + 4, sizeof(LogRecordHeader) - 4);
+    return checksum(data, header.length, hash);
+}
+
+WriteAheadLog::WriteAheadLog(string filename)
+    : logFile(filename), bufferStart(0), appendLsn(0), flushedLsn(0), flushing(false) {}
+
+LSN WriteAheadLog::appendRecord(uint16_t type, uint32_t fileId, uint32_t pageId,
+    uint32_t offset, const char* data, uint16_t length) {
+    LogRecordHeader header{ 0, type, length, fileId, pageId, offset };
+    header.checksum = recordChecksum(header, data);
+
+    lock_guard<mutex> lock(logMutex);
+    buffer.insert(buffer.end(), (const char*)&header, (const char*)&header + sizeof(header));
+    buffer.insert(buffer.end(), data, data + length);
+    appendLsn += sizeof(header) + length;
+    return appendLsn;
+}
+
+LSN WriteAheadLog::logPage(uint32_t fileId, uint32_t pageId, uint32_t offset, const char* data, uint16_t length) {
+    return appendRecord(PAGE_RECORD, fileId, pageId, offset, data, length);
+}
+
+LSN WriteAheadLog::logDelete(uint32_t fileId, uint32_t fromPage) {
+    return appendRecord(DELETE_RECORD, fileId, fromPage, 0, nullptr, 0);
+}
+
+LSN WriteAheadLog::logMetadata(uint32_t block, uint32_t pageCount, const char* data, uint16_t length) {
+    return appendRecord(META_RECORD, 0, block, pageCount, data, length);
+}
+
+LSN WriteAheadLog::logCommit() {
+    return appendRecord(COMMIT_RECORD, 0, 0, 0, nullptr, 0);
+}
+
+void WriteAheadLog::flush(LSN lsn) {
+    unique_lock<mutex> lock(logMutex);
+    while (flushedLsn < lsn) {
+        // Whoever comes first writes everything appended so far, the rest wait for it
+        if (flushing) {
+            flushDone.wait(lock);
+            continue;
+        }
+        flushing = true;
+        vector<char> data;
+        data.swap(buffer);
+        LSN start = bufferStart;
+        LSN end = appendLsn;
+        bufferStart = end;
+        lock.unlock();
+
+        logFile.write(start, data.data(), data.size());
+        logFile.sync();
+
+        lock.lock();
+        flushing = false;
+        flushedLsn = end;
+        flushDone.notify_all();
+    }
+}
+
+bool WriteAheadLog::truncate(LSN end) {
+    lock_guard<mutex> lock(logMutex);
+    if (flushing || !buffer.empty() || flushedLsn != appendLsn || appendLsn != end)
+        return false;
+    logFile.truncate(0);
+    logFile.sync();
+    bufferStart = appendLsn = flushedLsn = 0;
+    return true;
+}
+
+size_t WriteAheadLog::replay(function<void(const LogRecordHeader&, const char*)> apply) {
+    lock_guard<mutex> lock(logMutex);
+    vector<char> data(logFile.size());
+    data.resize(logFile.read(0, data.data(), data.size()));
+
+    size_t applied = 0;
+    size_t pos = 0;
+    size_t committedEnd = 0;
+    vector<size_t> pending;
+    while (pos + sizeof(LogRecordHeader) <= data.size()) {
+        LogRecordHeader header;
+        memcpy(&header, data.data() + pos, sizeof(header));
+        const char* payload = data.data() + pos + sizeof(header);
+        if (pos + sizeof(header) + header.length > data.size()) break;
+        if (header.checksum != recordChecksum(header, payload)) break;
+
+        if (header.type == PAGE_RECORD || header.type == DELETE_RECORD || header.type == META_RECORD)
+            pending.push_back(pos);
+        else if (header.type == COMMIT_RECORD) {
+            for (size_t p : pending) {
+                LogRecordHeader record;
+                memcpy(&record, data.data() + p, sizeof(record));
+                apply(record, data.data() + p + sizeof(record));
+                applied++;
+            }
+            pending.clear();
+            committedEnd = pos + sizeof(header);
+        }
+        else break;
+        pos += sizeof(header) + header.length;
+    }
+
+    // Anything after the last valid commit is dropped for good
+    if (committedEnd != data.size())
+        logFile.truncate(committedEnd);
+    bufferStart = appendLsn = flushedLsn = committedEnd;
+    return applied;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "Common.h"
+#include "DiskFile.h"
+#include <cstdint>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+using LSN = uint64_t;
+
+struct LogRecordHeader {
+    uint32_t checksum;
+    uint16_t type;
+    uint16_t length;
+    uint32_t fileId;
+    uint32_t pageId;
+    uint32_t offset;
+};
+
+class WriteAheadLog {
+private:
+    DiskFile logFile;
+    mutex logMutex;
+    condition_variable flushDone;
+    vector<char> buffer;
+    LSN bufferStart;
+    LSN appendLsn;
+    LSN flushedLsn;
+    bool flushing;
+
+    LSN appendRecord(uint16_t type, uint32_t fileId, uint32_t pageId,
+        uint32_t offset, const char* data, uint16_t length);
+public:
+    static const uint16_t PAGE_RECORD = 0x01;
+    static const uint16_t COMMIT_RECORD = 0x02;
+    static const uint16_t DELETE_RECORD = 0x03;
+    static const uint16_t META_RECORD = 0x04;
+
+    WriteAheadLog(string filename);
+
+    LSN logPage(uint32_t fileId, uint32_t pageId, uint32_t offset, const char* data, uint16_t length);
+    LSN logDelete(uint32_t fileId, uint32_t fromPage);
+    LSN logMetadata(uint32_t block, uint32_t pageCount, const char* data, uint16_t length);
+    LSN logCommit();
+    void flush(LSN lsn);
+    inline LSN size() {
+        lock_guard<mutex> lock(logMutex);
+        return appendLsn;
+    }
+    // Empties the log if everything up to end, and nothing after it, is on disk
+    bool truncate(LSN end);
+
+    // Calls apply for each record of every committed transaction
+    size_t replay(function<void(const LogRecordHeader&, const char*)> apply);
+};